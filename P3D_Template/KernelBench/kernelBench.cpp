@@ -0,0 +1,333 @@
+/*
+ Intersection kernel microbenchmark.
+ Times Sphere, Triangle, CompactTriangle, aaBox, Plane and AABB intercepts in isolation, on rays sampled from the scenes: the rays
+ leave the scene camera, either through a random pixel or towards a random point around the tested object, and are
+ split into hits and misses by the scalar kernel, so that every kernel runs on the same hit/miss mix. The tests are
+ shuffled, so that the branch predictor cannot learn the order of the hits.
+ A variant of a kernel (e.g. SIMD) is added to the kernel table next to the scalar one: it runs on the same tests and
+ its hits are checked against the scalar kernel.
+
+ Usage: KernelBench [-n tests] [-hit ratio] [-time ms] [-seed n] [-compact faces] [scene.p3f ...]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <IL/il.h>
+
+#include "scene.h"
+#include "maths.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KERNEL_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+unsigned int numTests = 1 << 16;   //tests per kernel and scene
+float hitRatio = 0.5f;
+double minTimeMs = 200;   //each measurement repeats the tests for at least this long
+int seed = 42;
+unsigned int compactMinFaces = 0;   //meshes loaded as CompactTriangles (0: none)
+
+/////////////////////////////////////////////////////////////////////// TEST SETS
+
+template <class T> struct KernelTest {
+	T* object;
+	Ray ray;
+};
+
+template <class T> struct TestSet {
+	vector<KernelTest<T> > tests;
+	unsigned int hits;
+};
+
+static AABB boundsOf(Object* object) { return object->GetBoundingBox(); }
+static AABB boundsOf(AABB* bbox) { return *bbox; }
+
+static float rand_signed() { return rand_float() * 2.0f - 1.0f; }
+
+// A ray from the camera through a random pixel, or towards a random point of the (enlarged) box of the object;
+// without a box (planes), in a random direction
+static Ray sampleRay(Camera* camera, AABB* bbox)
+{
+	if (rand_int() & 1) {
+		Vector pixel(rand_float() * camera->GetResX(), rand_float() * camera->GetResY(), 0);
+		return camera->PrimaryRay(pixel);
+	}
+	if (bbox == NULL) {
+		Vector dir(rand_signed(), rand_signed(), rand_signed());
+		return Ray(camera->GetEye(), dir.normalize());
+	}
+	Vector center = (bbox->min + bbox->max) * 0.5f;
+	Vector extent = (bbox->max - bbox->min) * 0.75f;   //half again the size of the box: part of the rays miss
+	Vector target = center + Vector(extent.x * rand_signed(), extent.y * rand_signed(), extent.z * rand_signed());
+	Vector eye = camera->GetEye();
+	Vector dir = target - eye;
+	return Ray(eye, dir.normalize());
+}
+
+// Samples rays against random objects until there are enough hits and misses for the hit ratio, then mixes them.
+// The mix has fewer tests when the scene gives too few hits or misses.
+template <class T, class Kernel>
+static TestSet<T> sampleTests(vector<T*>& objects, Camera* camera, Kernel scalar, bool use_bbox)
+{
+	vector<KernelTest<T> > hits, misses;
+	unsigned int want_hits = (unsigned int)(numTests * hitRatio);
+	unsigned int want_misses = numTests - want_hits;
+	unsigned long long attempts = 0, max_attempts = 64ull * numTests;
+
+	while ((hits.size() < want_hits || misses.size() < want_misses) && attempts++ < max_attempts) {
+		T* object = objects[rand_int() % objects.size()];
+		AABB bbox = boundsOf(object);
+		KernelTest<T> test = { object, sampleRay(camera, use_bbox ? &bbox : NULL) };
+		float t;
+		if (scalar(object, test.ray, t)) {
+			if (hits.size() < want_hits) hits.push_back(test);
+		}
+		else if (misses.size() < want_misses)
+			misses.push_back(test);
+	}
+
+	TestSet<T> set;
+	if (hits.size() < want_hits || misses.size() < want_misses) {
+		//keep the ratio with the tests there are
+		size_t n = min(hitRatio > 0 ? (size_t)(hits.size() / hitRatio) : misses.size(),
+			hitRatio < 1 ? (size_t)(misses.size() / (1 - hitRatio)) : hits.size());
+		hits.erase(hits.begin() + min(hits.size(), (size_t)(n * hitRatio)), hits.end());
+		misses.erase(misses.begin() + min(misses.size(), n - hits.size()), misses.end());
+	}
+	set.hits = hits.size();
+	set.tests = hits;
+	set.tests.insert(set.tests.end(), misses.begin(), misses.end());
+	for (size_t i = set.tests.size(); i > 1; i--)
+		swap(set.tests[i - 1], set.tests[((unsigned int)rand_int() << 15 | rand_int()) % i]);
+	return set;
+}
+
+/////////////////////////////////////////////////////////////////////// KERNELS
+
+// Non-virtual calls, so that the kernels are timed without the dispatch of the accelerators
+static bool sphereScalar(Sphere* s, Ray& r, float& t) { return s->Sphere::intercepts(r, t); }
+static bool triangleScalar(Triangle* tri, Ray& r, float& t) { return tri->Triangle::intercepts(r, t); }
+static bool compactTriangleScalar(CompactTriangle* tri, Ray& r, float& t) { return tri->CompactTriangle::intercepts(r, t); }
+static bool boxScalar(aaBox* b, Ray& r, float& t) { return b->aaBox::intercepts(r, t); }
+static bool planeScalar(Plane* p, Ray& r, float& t) { return p->Plane::intercepts(r, t); }
+static bool aabbScalar(AABB* b, Ray& r, float& t) { return b->intercepts(r, t); }
+
+#ifdef KERNEL_SSE
+// Slab test of the three axes at once; same results as AABB::intercepts
+static bool aabbSSE(AABB* b, Ray& r, float& t)
+{
+	__m128 o = _mm_set_ps(0, r.origin.z, r.origin.y, r.origin.x);
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_set_ps(1, r.direction.z, r.direction.y, r.direction.x));
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(0, b->min.z, b->min.y, b->min.x), o), inv);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(0, b->max.z, b->max.y, b->max.x), o), inv);
+	__m128 tmin = _mm_min_ps(t0, t1), tmax = _mm_max_ps(t0, t1);
+
+	float tn[4], tf[4];
+	_mm_storeu_ps(tn, tmin);
+	_mm_storeu_ps(tf, tmax);
+	float t_enter = MAX3(tn[0], tn[1], tn[2]);
+	float t_exit = MIN3(tf[0], tf[1], tf[2]);
+
+	t = (t_enter < 0) ? t_exit : t_enter;
+	return t_enter < t_exit && t_exit > 0;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////// TIMING
+
+struct KernelResult {
+	string kernel, variant, scene;
+	size_t tests;
+	unsigned int hits;
+	double ns_per_test;
+	unsigned int mismatches;   //tests where the variant and the scalar kernel disagree on the hit
+};
+
+vector<KernelResult> results;
+
+template <class T, class Kernel>
+static double timeKernel(TestSet<T>& set, Kernel kernel, unsigned int& hits)
+{
+	typedef chrono::steady_clock Clock;
+	double best = 0;
+	float t_sum = 0;   //results are used, so that the tests are not optimized away
+
+	//best of five measurements, each repeating the tests for at least the minimum time
+	for (int m = 0; m < 5; m++) {
+		unsigned long long n = 0;
+		Clock::time_point start = Clock::now();
+		double elapsed;
+		do {
+			hits = 0;
+			for (KernelTest<T>& test : set.tests) {
+				float t = 0;
+				if (kernel(test.object, test.ray, t)) {
+					hits++;
+					t_sum += t;
+				}
+			}
+			n += set.tests.size();
+			elapsed = chrono::duration<double, nano>(Clock::now() - start).count();
+		} while (elapsed < minTimeMs * 1e6);
+
+		double ns = elapsed / n;
+		if (m == 0 || ns < best) best = ns;
+	}
+	if (t_sum == -1.0f) printf(" ");
+	return best;
+}
+
+template <class T, class Kernel>
+static unsigned int countMismatches(TestSet<T>& set, Kernel scalar, Kernel variant)
+{
+	unsigned int mismatches = 0;
+	for (KernelTest<T>& test : set.tests) {
+		float t;
+		if (scalar(test.object, test.ray, t) != variant(test.object, test.ray, t)) mismatches++;
+	}
+	return mismatches;
+}
+
+template <class T>
+struct KernelVariant {
+	const char* name;
+	bool (*test)(T*, Ray&, float&);
+};
+
+// Samples the tests of a primitive with the scalar kernel (the first variant) and times every variant on them
+template <class T>
+static void benchKernel(const char* kernel, const string& scene_name, vector<T*>& objects, Camera* camera, bool use_bbox,
+	vector<KernelVariant<T> > variants)
+{
+	if (objects.empty()) return;
+
+	TestSet<T> set = sampleTests(objects, camera, variants[0].test, use_bbox);
+	if (set.tests.empty()) {
+		printf("%-9s %-8s %-22s no tests sampled\n", kernel, variants[0].name, scene_name.c_str());
+		return;
+	}
+
+	for (KernelVariant<T>& variant : variants) {
+		KernelResult r;
+		r.kernel = kernel;
+		r.variant = variant.name;
+		r.scene = scene_name;
+		r.tests = set.tests.size();
+		r.ns_per_test = timeKernel(set, variant.test, r.hits);
+		r.mismatches = countMismatches(set, variants[0].test, variant.test);
+		results.push_back(r);
+
+		printf("%-9s %-8s %-22s %8zu %6.1f%% %9.2f %10.2f", r.kernel.c_str(), r.variant.c_str(), r.scene.c_str(), r.tests,
+			100.0 * r.hits / r.tests, r.ns_per_test, 1e3 / r.ns_per_test);
+		if (r.mismatches) printf("   %u mismatches", r.mismatches);
+		printf("\n");
+	}
+}
+
+/////////////////////////////////////////////////////////////////////// MAIN
+
+static void benchScene(const char* file_name)
+{
+	Scene* scene = new Scene();
+	scene->SetCompactMeshes(compactMinFaces);
+	if (!scene->load_p3f(file_name)) {
+		printf("Error loading the scene %s\n", file_name);
+		delete scene;
+		return;
+	}
+	Camera* camera = scene->GetCamera();
+
+	string scene_name = file_name;
+	size_t slash = scene_name.find_last_of("/\\");
+	if (slash != string::npos) scene_name = scene_name.substr(slash + 1);
+	printf("\n%-9s %-8s %-22s %8s %7s %9s %10s\n", "kernel", "variant", "scene", "tests", "hits", "ns/test", "Mtests/s");
+
+	vector<Sphere*> spheres;
+	vector<Triangle*> triangles;
+	vector<CompactTriangle*> compact_triangles;
+	vector<aaBox*> boxes;
+	vector<Plane*> planes;
+	vector<AABB> bboxes;
+	for (int i = 0; i < scene->getNumObjects(); i++) {
+		Object* object = scene->getObject(i);
+		if (Sphere* s = dynamic_cast<Sphere*>(object)) spheres.push_back(s);
+		else if (Triangle* tri = dynamic_cast<Triangle*>(object)) triangles.push_back(tri);
+		else if (CompactTriangle* tri = dynamic_cast<CompactTriangle*>(object)) compact_triangles.push_back(tri);
+		else if (aaBox* b = dynamic_cast<aaBox*>(object)) boxes.push_back(b);
+		else if (Plane* p = dynamic_cast<Plane*>(object)) planes.push_back(p);
+		else continue;
+		if (!dynamic_cast<Plane*>(object)) bboxes.push_back(object->GetBoundingBox());   //the boxes the accelerators test
+	}
+	vector<AABB*> aabbs;
+	for (AABB& bbox : bboxes) aabbs.push_back(&bbox);
+
+	set_rand_seed(seed);
+	benchKernel<Sphere>("Sphere", scene_name, spheres, camera, true, { { "scalar", sphereScalar } });
+	benchKernel<Triangle>("Triangle", scene_name, triangles, camera, true, { { "scalar", triangleScalar } });
+	benchKernel<CompactTriangle>("Compact", scene_name, compact_triangles, camera, true, { { "scalar", compactTriangleScalar } });
+	benchKernel<aaBox>("aaBox", scene_name, boxes, camera, true, { { "scalar", boxScalar } });
+	benchKernel<Plane>("Plane", scene_name, planes, camera, false, { { "scalar", planeScalar } });
+	benchKernel<AABB>("AABB", scene_name, aabbs, camera, true, {
+		{ "scalar", aabbScalar },
+#ifdef KERNEL_SSE
+		{ "sse", aabbSSE },
+#endif
+	});
+
+	delete scene;   //with its objects
+}
+
+void printUsage(const char* program)
+{
+	printf("Usage: %s [options] [scene.p3f ...]\n", program);
+	printf("  -n <tests>      ray/object tests per kernel and scene (default %u)\n", numTests);
+	printf("  -hit <ratio>    fraction of the tests that hit (default %.2f)\n", hitRatio);
+	printf("  -time <ms>      minimum duration of each measurement (default %.0f)\n", minTimeMs);
+	printf("  -seed <n>       seed of the sampled rays (default %d)\n", seed);
+	printf("  -compact <faces> load the meshes with at least this many faces as CompactTriangles (default %u: none)\n", compactMinFaces);
+	printf("  Default scenes: P3D_Scenes/balls_box.p3f P3D_Scenes/balls_medium.p3f P3D_Scenes/mount_high.p3f\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if (ilGetInteger(IL_VERSION_NUM) < IL_VERSION)
+	{
+		printf("wrong DevIL version \n");
+		exit(0);
+	}
+	ilInit();
+
+	vector<string> scenes;
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "-n") && has_value) numTests = max(atoi(argv[++i]), 1);
+		else if (!strcmp(argv[i], "-hit") && has_value) hitRatio = min(max((float)atof(argv[++i]), 0.0f), 1.0f);
+		else if (!strcmp(argv[i], "-time") && has_value) minTimeMs = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && has_value) seed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-compact") && has_value) compactMinFaces = (unsigned int)max(atoi(argv[++i]), 0);
+		else if (argv[i][0] == '-') {
+			printUsage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		else scenes.push_back(argv[i]);
+	}
+	if (scenes.empty()) {
+		scenes.push_back("P3D_Scenes/balls_box.p3f");
+		scenes.push_back("P3D_Scenes/balls_medium.p3f");
+		scenes.push_back("P3D_Scenes/mount_high.p3f");
+	}
+
+	for (string& file_name : scenes) {
+		printf("\nScene %s\n", file_name.c_str());
+		benchScene(file_name.c_str());
+	}
+	return results.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include "allocCounter.h"
+
+#ifdef ALLOC_COUNT
+
+static thread_local unsigned long long threadAllocs = 0;
+static std::atomic<unsigned long long> renderAllocs(0);
+
+void* operator new(size_t size)
+{
+	threadAllocs++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { threadAllocs++; return malloc(size > 0 ? size : 1); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { threadAllocs++; return malloc(size > 0 ? size : 1); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+unsigned long long threadAllocations() { return threadAllocs; }
+
+void excludeThreadAllocations(unsigned long long n) { threadAllocs -= n; }
+
+void addRenderAllocations(unsigned long long n) { renderAllocs += n; }
+
+unsigned long long getRenderAllocations() { return renderAllocs; }
+
+void resetRenderAllocations() { renderAllocs = 0; }
+
+void printRenderAllocations()
+{
+	printf("Heap allocations while rendering: %llu\n", (unsigned long long)renderAllocs);
+}
+
+#endif
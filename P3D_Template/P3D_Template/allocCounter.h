@@ -0,0 +1,35 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+/*
+ Heap allocation counter, to check that the render loop does not allocate.
+ Compiled in only when ALLOC_COUNT is defined (add it to the preprocessor definitions of the project, as RAY_STATS);
+ it then replaces the global operator new, through which the standard containers and new allocate, and counts the
+ calls per thread. Direct malloc calls are not counted. The rendering threads add up the allocations made while
+ rendering their rows, after their setup; the regression mode fails an image rendered with any.
+ Ray captures buffer rays while rendering, so they allocate by design. The skybox faces are decoded, once per process,
+ by the first ray that reaches them, out-of-core meshes load their pages on a page fault and the trace stores the
+ span of each row; those allocations are left out.
+*/
+
+#ifdef ALLOC_COUNT
+
+unsigned long long threadAllocations();   //operator new calls of the calling thread so far
+void excludeThreadAllocations(unsigned long long n);   //not counted as made by the calling thread
+void addRenderAllocations(unsigned long long n);
+unsigned long long getRenderAllocations();
+void resetRenderAllocations();
+void printRenderAllocations();
+
+#else
+
+inline unsigned long long threadAllocations() { return 0; }
+inline void excludeThreadAllocations(unsigned long long) {}
+inline void addRenderAllocations(unsigned long long) {}
+inline unsigned long long getRenderAllocations() { return 0; }
+inline void resetRenderAllocations() {}
+inline void printRenderAllocations() {}
+
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <algorithm>
+#include "arena.h"
+#include "hugePages.h"
+
+Arena::Arena() : next(NULL), remaining(0), block_size(0), used(0), reserved(0) {}
+
+Arena::~Arena()
+{
+	clear();
+}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+	size_t padding = (alignment - (uintptr_t)next % alignment) % alignment;
+	if (next == NULL || padding + size > remaining) {
+		block_size = blocks.empty() ? ARENA_FIRST_BLOCK : min(2 * block_size, (size_t)ARENA_MAX_BLOCK);
+		size_t bytes = max(block_size - HUGE_ALLOC_HEADER, size + alignment);   //the large blocks fill whole huge pages
+		char* block = (char*)hugeAlloc(bytes);
+		if (block == NULL) throw bad_alloc();
+		blocks.push_back(block);
+		reserved += bytes;
+		next = block;
+		remaining = bytes;
+		padding = (alignment - (uintptr_t)next % alignment) % alignment;
+	}
+
+	char* p = next + padding;
+	next = p + size;
+	remaining -= padding + size;
+	used += size;
+	return p;
+}
+
+void Arena::clear()
+{
+	for (char* block : blocks)
+		hugeFree(block);
+	blocks.clear();
+	next = NULL;
+	remaining = 0;
+	used = reserved = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+using namespace std;
+
+/*
+ Monotonic arena: objects are placed one after the other in large blocks and are released all at once, when the
+ arena is cleared or destroyed, never one by one. The blocks grow from ARENA_FIRST_BLOCK up to ARENA_MAX_BLOCK bytes,
+ so small scenes take little memory and large ones few allocations.
+ Destructors are not run, so only trivially destructible types can be created in an arena.
+*/
+
+#define ARENA_FIRST_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (16 * 1024 * 1024)
+
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+
+	void* allocate(size_t size, size_t alignment);
+	void clear();   //releases every object and block
+
+	template <class T, class... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(is_trivially_destructible<T>::value, "arena objects are released without running their destructors");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	size_t getUsed() { return used; }   //bytes of the objects
+	size_t getReserved() { return reserved; }   //bytes of the blocks
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	vector<char*> blocks;
+	char* next;   //free space of the last block
+	size_t remaining;
+	size_t block_size;   //of the last block, doubled for the next one
+	size_t used, reserved;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <sstream>
+#include <stdio.h>
+#include "batch.h"
+
+bool readJob(istream& in, RenderJob& job, int& line_number)
+{
+	string line;
+
+	while (getline(in, line)) {
+		line_number++;
+
+		istringstream tokens(line);
+		string token;
+		if (!(tokens >> token) || token[0] == '#')
+			continue;
+
+		job.scene = token;
+		job.output = "";
+		job.spp = 0;
+		job.override_from = job.override_at = job.override_up = job.override_angle = false;
+		job.line = line_number;
+
+		bool ok = true;
+		while (ok && tokens >> token) {
+			if (token == "spp")
+				ok = (bool)(tokens >> job.spp) && job.spp > 0;
+			else if (token == "out")
+				ok = (bool)(tokens >> job.output);
+			else if (token == "from")
+				ok = job.override_from = (bool)(tokens >> job.from);
+			else if (token == "at")
+				ok = job.override_at = (bool)(tokens >> job.at);
+			else if (token == "up")
+				ok = job.override_up = (bool)(tokens >> job.up);
+			else if (token == "angle")
+				ok = job.override_angle = (bool)(tokens >> job.angle);
+			else {
+				printf("Job list line %d: unknown option '%s'\n", line_number, token.c_str());
+				ok = false;
+			}
+		}
+		if (!ok) {
+			printf("Job list line %d: job skipped\n", line_number);
+			continue;
+		}
+
+		if (job.output.empty()) {  //default output: scene name with png extension in the current directory
+			size_t slash = job.scene.find_last_of("/\\");
+			string name = slash == string::npos ? job.scene : job.scene.substr(slash + 1);
+			size_t dot = name.find_last_of('.');
+			job.output = (dot == string::npos ? name : name.substr(0, dot)) + ".png";
+		}
+		return true;
+	}
+	return false;
+}
+
+Camera* makeJobCamera(Camera* base, RenderJob& job)
+{
+	Vector from = job.override_from ? job.from : base->GetEye();
+	Vector at = job.override_at ? job.at : base->GetAt();
+	Vector up = job.override_up ? job.up : base->GetUp();
+	float angle = job.override_angle ? job.angle : base->GetFov();
+
+	return new Camera(from, at, up, angle, base->GetNear(), base->GetFar(), base->GetResX(), base->GetResY(),
+		base->GetApertureRatio(), base->GetFocalRatio());
+}
+
+/////////////////////////////////////////////////////////////////////// SCENE CACHE
+
+SceneCache::SceneCache(unsigned int capacity_) : capacity(capacity_ > 0 ? capacity_ : 1), hits(0), misses(0), evictions(0) {}
+
+SceneCache::~SceneCache()
+{
+	for (CachedScene* entry : entries)
+		Evict(entry);
+}
+
+CachedScene* SceneCache::Find(const string& key)
+{
+	for (list<CachedScene*>::iterator it = entries.begin(); it != entries.end(); it++) {
+		if ((*it)->key == key) {
+			hits++;
+			entries.splice(entries.begin(), entries, it);
+			return entries.front();
+		}
+	}
+	misses++;
+	return NULL;
+}
+
+void SceneCache::Insert(CachedScene* entry)
+{
+	entries.push_front(entry);
+	while (entries.size() > capacity) {
+		Evict(entries.back());
+		entries.pop_back();
+		evictions++;
+	}
+}
+
+void SceneCache::Evict(CachedScene* entry)
+{
+	delete entry->grid;
+	delete entry->bvh;
+	delete entry->scene;
+	delete entry;
+}
@@ -0,0 +1,67 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <list>
+#include <iostream>
+#include "scene.h"
+#include "rayAccelerator.h"
+
+using namespace std;
+
+/*
+ Headless batch rendering.
+ A job list has one job per line; blank lines and lines starting with '#' are skipped:
+	<scene.p3f> [spp N] [out file] [from x y z] [at x y z] [up x y z] [angle degrees]
+ Jobs are read one at a time, so the list may be a file or a pipe that keeps feeding jobs.
+ Parsed scenes and their accelerators are kept in a SceneCache between jobs.
+*/
+
+struct RenderJob {
+	string scene;
+	string output;
+	int spp;   //0: keep the current SPP
+	bool override_from, override_at, override_up, override_angle;
+	Vector from, at, up;
+	float angle;
+	int line;
+};
+
+//Reads the next job; returns false at the end of the list. Malformed lines are reported and skipped.
+bool readJob(istream& in, RenderJob& job, int& line_number);
+
+//Camera of the job: the scene camera with the job overrides applied
+Camera* makeJobCamera(Camera* base, RenderJob& job);
+
+struct CachedScene {
+	string key;
+	Scene* scene;
+	Grid* grid;
+	BVH* bvh;
+	int accel;   //Accelerator built, set again when the scene is taken from the cache
+	double parse_time, build_time;   //milliseconds
+};
+
+//LRU cache of parsed scenes and built accelerators
+class SceneCache
+{
+public:
+	SceneCache(unsigned int capacity_);
+	~SceneCache();
+
+	CachedScene* Find(const string& key);
+	void Insert(CachedScene* entry);   //evicts the least recently used scenes beyond the capacity
+
+	unsigned int getHits() { return hits; }
+	unsigned int getMisses() { return misses; }
+	unsigned int getEvictions() { return evictions; }
+
+private:
+	void Evict(CachedScene* entry);
+
+	list<CachedScene*> entries;   //most recently used at the front
+	unsigned int capacity;
+	unsigned int hits, misses, evictions;
+};
+
+#endif
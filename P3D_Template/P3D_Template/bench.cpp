@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <time.h>
+#include <sstream>
+#include "bench.h"
+
+vector<string> splitList(const string& list)
+{
+	vector<string> items;
+	istringstream in(list);
+	string item;
+	while (getline(in, item, ','))
+		if (!item.empty()) items.push_back(item);
+	return items;
+}
+
+// Text of a JSON string, without its quotes: the quotes, backslashes (of Windows paths) and control characters escaped
+static string jsonEscape(const string& text)
+{
+	string escaped;
+	for (unsigned char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (c < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		}
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+static bool writeJSON(FILE* file, const string& label, vector<BenchResult>& results)
+{
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(file, "{\n  \"label\": \"%s\",\n  \"date\": \"%s\",\n  \"results\": [\n", jsonEscape(label).c_str(), date);
+	for (size_t i = 0; i < results.size(); i++) {
+		BenchResult& r = results[i];
+		fprintf(file, "    {\"scene\": \"%s\", \"accel\": \"%s\", \"spp\": %d, \"threads\": %u, \"objects\": %d, ",
+			jsonEscape(r.scene).c_str(), jsonEscape(r.accel).c_str(), r.spp, r.threads, r.objects);
+		if (r.skipped)
+			fprintf(file, "\"skipped\": true}");
+		else
+			fprintf(file, "\"parse_ms\": %.3f, \"build_ms\": %.3f, \"render_ms\": %.3f, \"rays\": %llu, \"mrays_per_s\": %.3f, \"peak_rss_mb\": %.1f}",
+				r.parse_ms, r.build_ms, r.render_ms, r.rays, r.mrays_per_s, r.peak_rss_mb);
+		fprintf(file, i + 1 < results.size() ? ",\n" : "\n");
+	}
+	fprintf(file, "  ]\n}\n");
+	return !ferror(file);
+}
+
+static bool writeCSV(FILE* file, const string& label, vector<BenchResult>& results)
+{
+	fprintf(file, "label,scene,accel,spp,threads,objects,parse_ms,build_ms,render_ms,rays,mrays_per_s,peak_rss_mb\n");
+	for (BenchResult& r : results) {
+		fprintf(file, "%s,%s,%s,%d,%u,%d,", label.c_str(), r.scene.c_str(), r.accel.c_str(), r.spp, r.threads, r.objects);
+		if (r.skipped)
+			fprintf(file, ",,,,,\n");
+		else
+			fprintf(file, "%.3f,%.3f,%.3f,%llu,%.3f,%.1f\n", r.parse_ms, r.build_ms, r.render_ms, r.rays, r.mrays_per_s, r.peak_rss_mb);
+	}
+	return !ferror(file);
+}
+
+bool writeBenchResults(const char* file_name, const string& label, vector<BenchResult>& results)
+{
+	FILE* file = fopen(file_name, "w");
+	if (file == NULL) {
+		printf("Error opening the benchmark results file %s\n", file_name);
+		return false;
+	}
+
+	string name = file_name;
+	bool csv = name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0;
+	bool ok = csv ? writeCSV(file, label, results) : writeJSON(file, label, results);
+	ok = fclose(file) == 0 && ok;
+	if (!ok) printf("Error writing the benchmark results file %s\n", file_name);
+	return ok;
+}
+
+void printBenchResults(vector<BenchResult>& results)
+{
+	printf("\n%-22s %-5s %5s %7s %9s %10s %10s %11s %9s %9s\n", "scene", "accel", "spp", "threads", "objects", "parse ms", "build ms", "render ms", "Mrays/s", "peak MB");
+	for (BenchResult& r : results) {
+		if (r.skipped)
+			printf("%-22s %-5s %5d %7u %9d %10s\n", r.scene.c_str(), r.accel.c_str(), r.spp, r.threads, r.objects, "skipped");
+		else
+			printf("%-22s %-5s %5d %7u %9d %10.2f %10.2f %11.2f %9.3f %9.1f\n", r.scene.c_str(), r.accel.c_str(), r.spp, r.threads, r.objects,
+				r.parse_ms, r.build_ms, r.render_ms, r.mrays_per_s, r.peak_rss_mb);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ Benchmark mode: renders scenes under each accelerator, SPP and thread count and records, per run, the parse, build and
+ render times, the rays traced per second and the peak resident memory. Results are written as JSON or CSV (by the
+ extension of the output file), so that runs of different commits can be compared.
+*/
+
+struct BenchResult {
+	string scene;
+	string accel;
+	int spp;
+	unsigned int threads;
+	int objects;
+	double parse_ms, build_ms, render_ms;
+	unsigned long long rays;
+	double mrays_per_s;
+	double peak_rss_mb;   //peak of the process since the scene was loaded (since the start of the benchmark where it cannot be reset)
+	bool skipped;   //the accelerator is too slow for the scene
+};
+
+//Items of a comma separated list
+vector<string> splitList(const string& list);
+
+bool writeBenchResults(const char* file_name, const string& label, vector<BenchResult>& results);
+void printBenchResults(vector<BenchResult>& results);
+
+#endif
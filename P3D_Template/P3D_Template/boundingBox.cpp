@@ -3,6 +3,7 @@
 
 #include "boundingBox.h"
 #include "macros.h"
+#include "rayStats.h"
 
 //-------------------------------------------------------------------- - default constructor
 AABB::AABB(void) 
@@ -48,6 +49,12 @@ Vector AABB::centroid(void) {
 	return (min + max) / 2;
 }
 
+// --------------------------------------------------------------------- surface area
+float AABB::area(void) {
+	Vector d = max - min;
+	return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
 // --------------------------------------------------------------------- extend AABB
 void AABB::extend(AABB box) {
 	if (min.x > box.min.x) min.x = box.min.x;
@@ -69,6 +76,7 @@ bool AABB::intercepts(const AABB& a) {
 
 bool AABB::intercepts(const Ray& ray, float& t)
 {
+	STAT_INC(STAT_AABB_TESTS);
 	double t0, t1;
 
 	float ox = ray.origin.x;
@@ -17,6 +17,7 @@ public:
 	bool intercepts(const AABB& a);
 	bool intercepts(const Ray& r, float& t);
 	Vector centroid(void);
+	float area(void);   //surface area
 	void extend(AABB box);
 
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
+#include <climits>
 #include "rayAccelerator.h"
 #include "macros.h"
+#include "rayStats.h"
 using namespace std;
 
 BVH::BVHNode::BVHNode(void) {}
@@ -21,27 +23,103 @@ void BVH::BVHNode::makeNode(unsigned int left_index_) {
 
 BVH::BVH(void) {}
 
+BVH::~BVH(void) {}   //the nodes are released with their buffer
+
 int BVH::getNumObjects() { return objects.size(); }
 
 
+// The nodes are written into a buffer allocated once for the worst case, 2N - 1 nodes for N objects (every split
+// makes two non-empty children), and trimmed to the nodes used once the tree is built
 void BVH::Build(vector<Object *> &objs) 
 {
-	BVHNode *root = new BVHNode();
+	objects.clear();
+	nodes.clear();
+	qnodes.clear();
+	objects.reserve(objs.size());
+	nodes.reserve(max(2 * objs.size(), (size_t)2) - 1);
+	nodes.push_back(BVHNode());
 
 	Vector min = Vector(FLT_MAX, FLT_MAX, FLT_MAX), max = Vector(FLT_MIN, FLT_MIN, FLT_MIN);
 	AABB world_bbox = AABB(min, max);
 
+	unbounded.clear();
 	for (Object* obj : objs) {
+		if (!obj->IsBounded()) {
+			unbounded.push_back(obj);
+			continue;
+		}
 		AABB bbox = obj->GetBoundingBox();
 		world_bbox.extend(bbox);
 		objects.push_back(obj);
 	}
 	world_bbox.min.x -= EPSILON; world_bbox.min.y -= EPSILON; world_bbox.min.z -= EPSILON;
 	world_bbox.max.x += EPSILON; world_bbox.max.y += EPSILON; world_bbox.max.z += EPSILON;
-	root->setAABB(world_bbox);
-	nodes.push_back(root);
-	build_recursive(0, objects.size(), root); // -> root node takes all the 
-	int i = 0;
+	nodes[0].setAABB(world_bbox);
+	build_recursive(0, objects.size(), 0, 0); // -> root node takes all the 
+	nodes.shrink_to_fit();
+
+	//a tree with a single leaf, or with leaves too large for the 16-bit counts, keeps its float nodes
+	unsigned int max_leaf = 0;
+	for (BVHNode& node : nodes)
+		if (node.isLeaf()) max_leaf = std::max(max_leaf, node.getNObjs());
+	if (quantized && !nodes[0].isLeaf() && max_leaf <= USHRT_MAX && objects.size() < QBVH_LEAF) {
+		AABB& root = nodes[0].getAABB();
+		qroot_bbox = { { root.min.x, root.min.y, root.min.z }, { root.max.x, root.max.y, root.max.z } };
+		qnodes.reserve(nodes.size() / 2);   //one quantized node per inner node
+		quantize(0, qroot_bbox);
+		NodeBuffer().swap(nodes);
+	}
+}
+
+static inline float axisValue(const Vector& v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+// Box of a child of a quantized node, from the decoded box of the node: its min is lo steps of 1/255 of the node
+// extent above the min of the node and its max hi steps below the max, so that 0 decodes to the box of the node exactly
+inline void BVH::decodeBox(const QBox& parent, const QuantizedNode& node, int child, QBox& bbox)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		float step = (parent.max[axis] - parent.min[axis]) * (1.0f / 255);
+		bbox.min[axis] = parent.min[axis] + node.lo[child][axis] * step;
+		bbox.max[axis] = parent.max[axis] - node.hi[child][axis] * step;
+	}
+}
+
+// Writes the quantized node of the inner node node_index, whose decoded box is bbox, and those of its inner
+// descendants. The offsets are the largest whose decoded box, computed as in the traversal, still contains the exact
+// box of the child; the children are quantized in their decoded boxes, so the error does not add up down the tree.
+unsigned int BVH::quantize(unsigned int node_index, const QBox& bbox)
+{
+	unsigned int q = qnodes.size();
+	qnodes.push_back(QuantizedNode());
+
+	for (int c = 0; c < 2; c++) {
+		BVHNode& child = nodes[nodes[node_index].getIndex() + c];
+		AABB& exact = child.getAABB();
+		for (int axis = 0; axis < 3; axis++) {
+			float min = bbox.min[axis], max = bbox.max[axis];
+			float step = (max - min) * (1.0f / 255);
+			float child_min = axisValue(exact.min, axis), child_max = axisValue(exact.max, axis);
+			int lo = step > 0 ? (int)std::min(std::max((child_min - min) / step, 0.0f), 255.0f) : 255;
+			int hi = step > 0 ? (int)std::min(std::max((max - child_max) / step, 0.0f), 255.0f) : 255;
+			while (lo > 0 && min + lo * step > child_min) lo--;
+			while (hi > 0 && max - hi * step < child_max) hi--;
+			qnodes[q].lo[c][axis] = (unsigned char)lo;
+			qnodes[q].hi[c][axis] = (unsigned char)hi;
+		}
+
+		if (child.isLeaf()) {
+			qnodes[q].child[c] = QBVH_LEAF | child.getIndex();
+			qnodes[q].n_objs[c] = (unsigned short)child.getNObjs();
+		}
+		else {
+			QBox child_bbox;
+			decodeBox(bbox, qnodes[q], c, child_bbox);
+			unsigned int inner = quantize(nodes[node_index].getIndex() + c, child_bbox);
+			qnodes[q].child[c] = inner;
+			qnodes[q].n_objs[c] = 0;
+		}
+	}
+	return q;
 }
 
 int BVH::GetLargestAxis(AABB aabb, float& midPoint, int left_index, int right_index) {
@@ -122,32 +200,31 @@ AABB BVH::GetNodeBB(int left_index, int right_index)
 	return node_bb;
 }
 
-void BVH::build_recursive(int left_index, int right_index, BVHNode *node) {
+void BVH::build_recursive(int left_index, int right_index, int node_index, int depth) {
 	float midPoint = 0.0f;
-	BVHNode* left = new BVHNode();
-	BVHNode *right =  new BVHNode();
 	int largestAxis, split_index;
 
-	if (right_index - left_index <= Threshold) { //leaf node 
-		node->makeLeaf(left_index, right_index - left_index);
+	if (right_index - left_index <= Threshold || depth == BVH_MAX_DEPTH) { //leaf node 
+		nodes[node_index].makeLeaf(left_index, right_index - left_index);
 		return;
 	}
 	else {
-		largestAxis = GetLargestAxis(node->getAABB(), midPoint, left_index, right_index);
+		int left = nodes.size(), right = left + 1;
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+
+		largestAxis = GetLargestAxis(nodes[node_index].getAABB(), midPoint, left_index, right_index);
 		sortByAxis(largestAxis, left_index, right_index);
 		split_index = getSplitIndex(midPoint, largestAxis, left_index, right_index);
 		if (split_index == left_index || split_index == right_index || split_index == -1) split_index = round((right_index + left_index) / 2); //make sure that neither left or right is completely empty
 
-		left->setAABB(GetNodeBB(left_index, split_index));
-		right->setAABB(GetNodeBB(split_index, right_index));
+		nodes[left].setAABB(GetNodeBB(left_index, split_index));
+		nodes[right].setAABB(GetNodeBB(split_index, right_index));
 
-		node->makeNode(nodes.size());
-		
-		nodes.push_back(left);
-		nodes.push_back(right);
+		nodes[node_index].makeNode(left);
 
-		build_recursive(left_index, split_index, left);
-		build_recursive(split_index, right_index, right);
+		build_recursive(left_index, split_index, left, depth + 1);
+		build_recursive(split_index, right_index, right, depth + 1);
 		
 	}
 
@@ -158,33 +235,40 @@ void BVH::build_recursive(int left_index, int right_index, BVHNode *node) {
 }
 
 bool BVH::Traverse(Ray& ray, Object** hit_obj, Vector& hit_point) {
+	if (!qnodes.empty()) return TraverseQuantized(ray, hit_obj, hit_point);
 
 	float t_closest = FLT_MAX;  //contains the closest primitive intersection
 	bool aux = true;
 	Object* closestHit = nullptr;
-	ray.direction.normalize();
-	Ray localRay = ray;
-	BVHNode* currentNode = nodes[0];
+	Ray localRay = ray;   //not normalized: the primitive tests see the ray of the caller, as without an accelerator
+	BVHNode* currentNode = &nodes[0];
+	StackItem hit_stack[BVH_MAX_DEPTH];  //local so that several threads can traverse the BVH
+	int top = 0;
 	AABB closestBB;
 	float t_left, t_right, t;
 
 	bool left_hit, right_hit;
 	int leftChild, rightChild;
 
-	if (!nodes[0]->getAABB().intercepts(localRay, t))
+	//the unbounded objects are compared with the hit of the tree once it is found, as the pruning of the stack
+	//relies on the box of the closest hit
+	float t_unbounded = FLT_MAX;
+	Object* unboundedObj = closestUnbounded(unbounded, localRay, t_unbounded);
+
+	if (!nodes[0].getAABB().intercepts(localRay, t))
 	{
 
-		return false;
+		return unboundedHit(unboundedObj, t_unbounded, localRay, hit_obj, hit_point);
 
 	}
 	while (true)
 	{
-		
+		STAT_INC(STAT_BVH_NODES);
 		if (!currentNode->isLeaf()) {
 			leftChild = currentNode->getIndex();
 			rightChild = currentNode->getIndex() + 1;
-			left_hit = nodes[leftChild]->getAABB().intercepts(localRay, t_left) ;
-			right_hit =  nodes[rightChild]->getAABB().intercepts(localRay, t_right);
+			left_hit = nodes[leftChild].getAABB().intercepts(localRay, t_left) ;
+			right_hit =  nodes[rightChild].getAABB().intercepts(localRay, t_right);
 
 			
 			if (left_hit && right_hit){
@@ -195,17 +279,16 @@ bool BVH::Traverse(Ray& ray, Object** hit_obj, Vector& hit_point) {
 				t = leftCloser ? t_left : t_right;
 				nextNode = leftCloser ? rightChild : leftChild;
 
-				currentNode = nodes[nextNode];
-				StackItem stackitem = StackItem(nodes[stackNode], t);
-				hit_stack.push(stackitem);
+				currentNode = &nodes[nextNode];
+				hit_stack[top++] = StackItem(&nodes[stackNode], t);
 				continue;
 			}
 			else if (left_hit && !right_hit) {
-				currentNode = nodes[leftChild];			
+				currentNode = &nodes[leftChild];			
 				continue;
 			}
 			else if (right_hit && !left_hit) {
-				currentNode = nodes[rightChild];
+				currentNode = &nodes[rightChild];
 				continue;
 			}
 		}
@@ -219,18 +302,21 @@ bool BVH::Traverse(Ray& ray, Object** hit_obj, Vector& hit_point) {
 			}
 		}
 		while (true) {
-			if (hit_stack.empty()) {
+			if (top == 0) {
+				if (unboundedObj != nullptr && t_unbounded < t_closest) {
+					closestHit = unboundedObj;
+					t_closest = t_unbounded;
+				}
 				if (closestHit == nullptr)
 					return false;
 				else {
 					*hit_obj = closestHit;
-					hit_point = ray.origin + ray.direction * t_closest;
+					hit_point = localRay.origin + localRay.direction * t_closest;
 					return true;
 				}
 			}
 			else {
-				StackItem item = hit_stack.top();
-				hit_stack.pop();
+				StackItem item = hit_stack[--top];
 				if (item.t < t_closest || item.ptr->getAABB().intercepts( closestBB)) /*best  BB overlaps this new itm's BB*/ {
 					currentNode = item.ptr;
 					break;
@@ -242,65 +328,337 @@ bool BVH::Traverse(Ray& ray, Object** hit_obj, Vector& hit_point) {
 }
 
 bool BVH::Traverse(Ray& ray) {  //shadow ray
+	if (!qnodes.empty()) return TraverseQuantized(ray);
 
 	double length = ray.direction.length(); //distance between light and intersection point
 	ray.direction.normalize();
 
 	Ray localRay = ray;
-	BVHNode* currentNode = nodes[0];
+	if (anyUnbounded(unbounded, localRay, length))
+		return true;
+
+	BVHNode* currentNode = &nodes[0];
+	StackItem hit_stack[BVH_MAX_DEPTH];
+	int top = 0;
 	float t_left, t_right, t_closest, t;
 	int leftChild, rightChild;
 	bool left_hit, right_hit;
 
 	
 
-	if (!nodes[0]->getAABB().intercepts(localRay, t))
+	if (!nodes[0].getAABB().intercepts(localRay, t))
 		return false;
 	while (true)
 	{
+		STAT_INC(STAT_BVH_NODES);
 		if (!currentNode->isLeaf()) {
 			leftChild = currentNode->getIndex();
 			rightChild = currentNode->getIndex() + 1;
-			left_hit = nodes[leftChild]->getAABB().intercepts(localRay, t_left);
-			right_hit =  nodes[rightChild]->getAABB().intercepts(localRay, t_right);
+			left_hit = nodes[leftChild].getAABB().intercepts(localRay, t_left);
+			right_hit =  nodes[rightChild].getAABB().intercepts(localRay, t_right);
 
 
 			if (left_hit && right_hit) {
-				currentNode = nodes[leftChild];
-				StackItem stackitem = StackItem(nodes[rightChild], t);
-				hit_stack.push(stackitem);
+				currentNode = &nodes[leftChild];
+				hit_stack[top++] = StackItem(&nodes[rightChild], t);
 				continue;
 			}
 			else if (left_hit && !right_hit) {
-				currentNode = nodes[leftChild];
+				currentNode = &nodes[leftChild];
 				continue;
 			}
 			else if (right_hit && !left_hit) {
-				currentNode = nodes[rightChild];
+				currentNode = &nodes[rightChild];
 				continue;
 			}
 		}
 		else {  //isleaf
 			for (int i = currentNode->getIndex(); i < currentNode->getIndex() + currentNode->getNObjs(); i++) {
-				if (objects.at(i)->intercepts(localRay, t) && t < length) {
-					while (!hit_stack.empty()) {
-						hit_stack.pop();
-					}
+				if (objects.at(i)->intercepts(localRay, t) && t < length)
 					return true;
-				}
 			}
 		}
 		while (true) {
-			if (hit_stack.empty()) {
+			if (top == 0) {
 				return false;
 			}
 			else {
-				StackItem item = hit_stack.top();
-				hit_stack.pop();
-				currentNode = item.ptr;
+				currentNode = hit_stack[--top].ptr;
 				break;
 			}
 		}
 
 	}
 	}		
+
+void BVH::decodeNodes(NodeBuffer& tree)
+{
+	vector<QBox> boxes(1, qroot_bbox);   //decoded box of each float node
+	boxes.reserve(2 * qnodes.size() + 1);
+	tree.assign(1, BVHNode());
+	tree.reserve(2 * qnodes.size() + 1);
+
+	stack<pair<unsigned int, unsigned int> > pending;   //quantized node and its float node
+	pending.push(make_pair(0u, 0u));
+	while (!pending.empty()) {
+		unsigned int q = pending.top().first, index = pending.top().second;
+		pending.pop();
+		unsigned int left = tree.size();
+		tree.push_back(BVHNode());
+		tree.push_back(BVHNode());
+		boxes.resize(tree.size());
+		tree[index].makeNode(left);
+		for (int c = 0; c < 2; c++) {
+			decodeBox(boxes[index], qnodes[q], c, boxes[left + c]);
+			if (qnodes[q].child[c] & QBVH_LEAF) tree[left + c].makeLeaf(qnodes[q].child[c] & ~QBVH_LEAF, qnodes[q].n_objs[c]);
+			else pending.push(make_pair(qnodes[q].child[c], left + c));
+		}
+	}
+	for (size_t i = 0; i < tree.size(); i++) {
+		AABB bbox(Vector(boxes[i].min[0], boxes[i].min[1], boxes[i].min[2]), Vector(boxes[i].max[0], boxes[i].max[1], boxes[i].max[2]));
+		tree[i].setAABB(bbox);
+	}
+}
+
+// Slab test of a decoded box, as AABB::intercepts, with the inverse of the ray direction computed once per ray
+static inline bool interceptsBox(const float bmin[3], const float bmax[3], const float origin[3], const float inv_dir[3], float& t)
+{
+	STAT_INC(STAT_AABB_TESTS);
+	float t_min[3], t_max[3];
+	for (int axis = 0; axis < 3; axis++) {
+		if (inv_dir[axis] >= 0) {
+			t_min[axis] = (bmin[axis] - origin[axis]) * inv_dir[axis];
+			t_max[axis] = (bmax[axis] - origin[axis]) * inv_dir[axis];
+		}
+		else {
+			t_min[axis] = (bmax[axis] - origin[axis]) * inv_dir[axis];
+			t_max[axis] = (bmin[axis] - origin[axis]) * inv_dir[axis];
+		}
+	}
+	float t0 = MAX3(t_min[0], t_min[1], t_min[2]);   //largest entering t value
+	float t1 = MIN3(t_max[0], t_max[1], t_max[2]);   //smallest exiting t value
+	t = (t0 < 0) ? t1 : t0;
+	return (t0 < t1 && t1 > 0);
+}
+
+static inline bool overlaps(const float amin[3], const float amax[3], const float bmin[3], const float bmax[3])
+{
+	return amin[0] <= bmax[0] && amax[0] >= bmin[0] && amin[1] <= bmax[1] && amax[1] >= bmin[1] &&
+		amin[2] <= bmax[2] && amax[2] >= bmin[2];
+}
+
+// Traversals of the quantized tree: as those of the float nodes, but the boxes of the children are decoded from the box
+// of their parent, which is carried down the tree and on the stack
+bool BVH::TraverseQuantized(Ray& ray, Object** hit_obj, Vector& hit_point) {
+	float t_closest = FLT_MAX;
+	Object* closestHit = nullptr;
+	Ray localRay = ray;
+	float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	float inv_dir[3] = { (float)(1.0 / localRay.direction.x), (float)(1.0 / localRay.direction.y), (float)(1.0 / localRay.direction.z) };
+	QStackItem hit_stack[BVH_MAX_DEPTH];
+	int top = 0;
+	QBox closestBB;
+	float t_left, t_right, t;
+
+	float t_unbounded = FLT_MAX;
+	Object* unboundedObj = closestUnbounded(unbounded, localRay, t_unbounded);
+
+	if (!interceptsBox(qroot_bbox.min, qroot_bbox.max, origin, inv_dir, t))
+		return unboundedHit(unboundedObj, t_unbounded, localRay, hit_obj, hit_point);
+	QStackItem current(0, 0, qroot_bbox, t);
+	while (true)
+	{
+		STAT_INC(STAT_BVH_NODES);
+		if (!(current.ref & QBVH_LEAF)) {
+			QuantizedNode& node = qnodes[current.ref];
+			QBox left_bbox, right_bbox;
+			decodeBox(current.bbox, node, 0, left_bbox);
+			decodeBox(current.bbox, node, 1, right_bbox);
+			bool left_hit = interceptsBox(left_bbox.min, left_bbox.max, origin, inv_dir, t_left);
+			bool right_hit = interceptsBox(right_bbox.min, right_bbox.max, origin, inv_dir, t_right);
+
+			if (left_hit && right_hit) {
+				QStackItem left(node.child[0], node.n_objs[0], left_bbox, t_left), right(node.child[1], node.n_objs[1], right_bbox, t_right);
+				bool leftCloser = t_left < t_right;
+				hit_stack[top++] = leftCloser ? right : left;
+				current = leftCloser ? left : right;
+				continue;
+			}
+			else if (left_hit) {
+				current = QStackItem(node.child[0], node.n_objs[0], left_bbox, t_left);
+				continue;
+			}
+			else if (right_hit) {
+				current = QStackItem(node.child[1], node.n_objs[1], right_bbox, t_right);
+				continue;
+			}
+		}
+		else {  //leaf
+			unsigned int first = current.ref & ~QBVH_LEAF;
+			for (unsigned int i = first; i < first + current.n_objs; i++) {
+				if (objects[i]->intercepts(localRay, t) && t < t_closest) {
+					t_closest = t;
+					closestHit = objects[i];
+					closestBB = current.bbox;
+				}
+			}
+		}
+		while (true) {
+			if (top == 0) {
+				if (unboundedObj != nullptr && t_unbounded < t_closest) {
+					closestHit = unboundedObj;
+					t_closest = t_unbounded;
+				}
+				if (closestHit == nullptr)
+					return false;
+				*hit_obj = closestHit;
+				hit_point = localRay.origin + localRay.direction * t_closest;
+				return true;
+			}
+			QStackItem item = hit_stack[--top];
+			if (item.t < t_closest || (closestHit && overlaps(item.bbox.min, item.bbox.max, closestBB.min, closestBB.max))) {
+				current = item;
+				break;
+			}
+		}
+	}
+}
+
+bool BVH::TraverseQuantized(Ray& ray) {  //shadow ray
+	double length = ray.direction.length(); //distance between light and intersection point
+	ray.direction.normalize();
+	Ray localRay = ray;
+	if (anyUnbounded(unbounded, localRay, length))
+		return true;
+
+	float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	float inv_dir[3] = { (float)(1.0 / ray.direction.x), (float)(1.0 / ray.direction.y), (float)(1.0 / ray.direction.z) };
+	QStackItem hit_stack[BVH_MAX_DEPTH];
+	int top = 0;
+	float t_left, t_right, t;
+
+	if (!interceptsBox(qroot_bbox.min, qroot_bbox.max, origin, inv_dir, t))
+		return false;
+	QStackItem current(0, 0, qroot_bbox, t);
+	while (true)
+	{
+		STAT_INC(STAT_BVH_NODES);
+		if (!(current.ref & QBVH_LEAF)) {
+			QuantizedNode& node = qnodes[current.ref];
+			QBox left_bbox, right_bbox;
+			decodeBox(current.bbox, node, 0, left_bbox);
+			decodeBox(current.bbox, node, 1, right_bbox);
+			bool left_hit = interceptsBox(left_bbox.min, left_bbox.max, origin, inv_dir, t_left);
+			bool right_hit = interceptsBox(right_bbox.min, right_bbox.max, origin, inv_dir, t_right);
+
+			if (left_hit && right_hit) {
+				hit_stack[top++] = QStackItem(node.child[1], node.n_objs[1], right_bbox, t_right);
+				current = QStackItem(node.child[0], node.n_objs[0], left_bbox, t_left);
+				continue;
+			}
+			else if (left_hit) {
+				current = QStackItem(node.child[0], node.n_objs[0], left_bbox, t_left);
+				continue;
+			}
+			else if (right_hit) {
+				current = QStackItem(node.child[1], node.n_objs[1], right_bbox, t_right);
+				continue;
+			}
+		}
+		else {  //leaf
+			unsigned int first = current.ref & ~QBVH_LEAF;
+			for (unsigned int i = first; i < first + current.n_objs; i++)
+				if (objects[i]->intercepts(localRay, t) && t < length)
+					return true;
+		}
+		if (top == 0)
+			return false;
+		current = hit_stack[--top];
+	}
+}
+
+// Costs of the surface area heuristic, relative: a node traversal and a primitive intersection test
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_INTERSECTION_COST 1.0f
+
+size_t BVH::GetMemory()
+{
+	return sizeof(BVH) + nodes.capacity() * sizeof(BVHNode) + qnodes.capacity() * sizeof(QuantizedNode) +
+		objects.capacity() * sizeof(Object*) + unbounded.capacity() * sizeof(Object*);
+}
+
+// The leaves split at the midpoint hold about half of Threshold objects, so a tree has about 4n / Threshold nodes.
+// The build writes them into a buffer of 2n - 1 nodes, copied into one of the nodes used, and a quantized tree is then
+// built next to them
+size_t BVH::EstimateMemory(size_t n_objects, size_t& build_peak)
+{
+	size_t n_nodes = std::max(4 * n_objects / std::max(Threshold, 1), (size_t)1) | 1;   //odd, as every split adds two
+	size_t node_bytes = n_nodes * sizeof(BVHNode), qnode_bytes = n_nodes / 2 * sizeof(QuantizedNode);
+	size_t objects_bytes = sizeof(BVH) + n_objects * sizeof(Object*);
+
+	build_peak = objects_bytes + std::max(2 * n_objects, (size_t)2) * sizeof(BVHNode) + node_bytes + (quantized ? qnode_bytes : 0);
+	return objects_bytes + (quantized && n_nodes > 1 ? qnode_bytes : node_bytes);
+}
+
+void BVH::PrintReport()
+{
+	//the statistics of a quantized tree are those of its decoded boxes
+	NodeBuffer decoded;
+	if (!qnodes.empty()) decodeNodes(decoded);
+	NodeBuffer& tree = qnodes.empty() ? nodes : decoded;
+
+	vector<unsigned int> leaf_sizes, depth_leaves;
+	size_t n_leaves = 0, n_overlapping = 0;
+	double sah = 0, overlap = 0;
+	float root_area = tree[0].getAABB().area();
+
+	//depth first from the root, with the depth of each node
+	stack<pair<unsigned int, unsigned int> > pending;
+	pending.push(make_pair(0u, 0u));
+	while (!pending.empty()) {
+		unsigned int index = pending.top().first, depth = pending.top().second;
+		pending.pop();
+		BVHNode* node = &tree[index];
+		float area_ratio = root_area > 0 ? node->getAABB().area() / root_area : 1;
+
+		if (node->isLeaf()) {
+			n_leaves++;
+			leaf_sizes.push_back(node->getNObjs());
+			if (depth >= depth_leaves.size()) depth_leaves.resize(depth + 1, 0);
+			depth_leaves[depth]++;
+			sah += SAH_INTERSECTION_COST * node->getNObjs() * area_ratio;
+			continue;
+		}
+		sah += SAH_TRAVERSAL_COST * area_ratio;
+
+		//overlap of the two children, as a fraction of the area of the parent
+		AABB& left = tree[node->getIndex()].getAABB();
+		AABB& right = tree[node->getIndex() + 1].getAABB();
+		Vector low(std::max(left.min.x, right.min.x), std::max(left.min.y, right.min.y), std::max(left.min.z, right.min.z));
+		Vector high(std::min(left.max.x, right.max.x), std::min(left.max.y, right.max.y), std::min(left.max.z, right.max.z));
+		if (low.x < high.x && low.y < high.y && low.z < high.z) {
+			n_overlapping++;
+			float parent_area = node->getAABB().area();
+			if (parent_area > 0) overlap += AABB(low, high).area() / parent_area;
+		}
+
+		pending.push(make_pair(node->getIndex(), depth + 1));
+		pending.push(make_pair(node->getIndex() + 1, depth + 1));
+	}
+
+	size_t n_inner = tree.size() - n_leaves;
+	size_t bytes = GetMemory();
+
+	printf("\nBVH REPORT: %zu nodes (%zu inner, %zu leaves), %d objects (Threshold = %d)%s\n", tree.size(), n_inner, n_leaves,
+		getNumObjects(), Threshold, qnodes.empty() ? "" : ", quantized");
+	printf("Unbounded objects: %zu, tested on every ray\n", unbounded.size());
+	printf("SAH cost: %.2f (traversal %.1f, intersection %.1f)\n", sah, SAH_TRAVERSAL_COST, SAH_INTERSECTION_COST);
+	printf("Sibling overlap: %zu of %zu pairs overlap, mean overlap %.2f%% of the parent area\n", n_overlapping, n_inner,
+		n_inner > 0 ? 100.0 * overlap / n_inner : 0.0);
+	printSizeHistogram("Objects per leaf", leaf_sizes);
+	printf("Leaf depth: max %zu\n", depth_leaves.size() - 1);
+	for (size_t d = 0; d < depth_leaves.size(); d++)
+		if (depth_leaves[d] > 0) printf("  %-11zu %10u  %5.1f%%\n", d, depth_leaves[d], 100.0 * depth_leaves[d] / n_leaves);
+	printf("Memory: %.1f KB (nodes %.1f KB)\n", bytes / 1024.0,
+		(nodes.capacity() * sizeof(BVHNode) + qnodes.capacity() * sizeof(QuantizedNode)) / 1024.0);
+}
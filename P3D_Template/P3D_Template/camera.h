@@ -16,19 +16,24 @@ class Camera
 
 private:
 	Vector eye, at, up;
-	float fovy, vnear, vfar, plane_dist, focal_ratio, aperture;
+	float fovy, vnear, vfar, plane_dist, focal_ratio, aperture_ratio, aperture;
 	float w, h;
 	int res_x, res_y;
 	Vector u, v, n;
 
 public:
 	Vector GetEye() { return eye; }
+	Vector GetAt() { return at; }
+	Vector GetUp() { return up; }
 	int GetResX() { return res_x; }
 	int GetResY() { return res_y; }
 	float GetFov() { return fovy; }
 	float GetPlaneDist() { return plane_dist; }
+	float GetNear() { return vnear; }
 	float GetFar() { return vfar; }
 	float GetAperture() { return aperture; }
+	float GetApertureRatio() { return aperture_ratio; }
+	float GetFocalRatio() { return focal_ratio; }
 
 	Camera(Vector from, Vector At, Vector Up, float angle, float hither, float yon, int ResX, int ResY, float Aperture_ratio, float Focal_ratio) {
 		eye = from;
@@ -40,6 +45,7 @@ public:
 		res_x = ResX;
 		res_y = ResY;
 		focal_ratio = Focal_ratio;
+		aperture_ratio = Aperture_ratio;
 
 		// set the camera frame uvn
 		n = (eye - at);
@@ -0,0 +1,118 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdio.h>
+#include "cameraPath.h"
+
+CameraPath::CameraPath() : output_pattern("frame_%04d.png"), num_frames(0), spp(0), resolved(false) {}
+
+bool CameraPath::Load(const char* path_file)
+{
+	ifstream file(path_file, ios::in);
+	if (file.fail()) {
+		printf("\nError opening the camera path %s.\n", path_file);
+		return false;
+	}
+
+	string line, token;
+	int line_number = 0;
+	while (getline(file, line)) {
+		line_number++;
+		istringstream tokens(line);
+		if (!(tokens >> token) || token[0] == '#')
+			continue;
+
+		bool ok = true;
+		if (token == "scene")
+			ok = (bool)(tokens >> scene);
+		else if (token == "frames")
+			ok = (bool)(tokens >> num_frames) && num_frames > 0;
+		else if (token == "out")
+			ok = (bool)(tokens >> output_pattern);
+		else if (token == "spp")
+			ok = (bool)(tokens >> spp) && spp > 0;
+		else if (token == "key") {
+			Key key;
+			key.has_from = key.has_at = key.has_up = key.has_angle = false;
+			ok = (bool)(tokens >> key.frame);
+			while (ok && tokens >> token) {
+				if (token == "from") ok = key.has_from = (bool)(tokens >> key.from);
+				else if (token == "at") ok = key.has_at = (bool)(tokens >> key.at);
+				else if (token == "up") ok = key.has_up = (bool)(tokens >> key.up);
+				else if (token == "angle") ok = key.has_angle = (bool)(tokens >> key.angle);
+				else ok = false;
+			}
+			if (ok) keys.push_back(key);
+		}
+		else
+			ok = false;
+
+		if (!ok) {
+			printf("Camera path line %d: invalid statement '%s'\n", line_number, line.c_str());
+			return false;
+		}
+	}
+
+	if (scene.empty() || num_frames == 0 || keys.empty()) {
+		printf("Camera path %s needs a scene, the number of frames and at least one key.\n", path_file);
+		return false;
+	}
+	stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.frame < b.frame; });
+	return true;
+}
+
+// Fills in the values each key does not set
+void CameraPath::resolveKeys(Camera* base)
+{
+	Key previous;
+	previous.from = base->GetEye();
+	previous.at = base->GetAt();
+	previous.up = base->GetUp();
+	previous.angle = base->GetFov();
+
+	for (Key& key : keys) {
+		if (!key.has_from) key.from = previous.from;
+		if (!key.has_at) key.at = previous.at;
+		if (!key.has_up) key.up = previous.up;
+		if (!key.has_angle) key.angle = previous.angle;
+		previous = key;
+	}
+	resolved = true;
+}
+
+static Vector catmullRom(Vector p0, Vector p1, Vector p2, Vector p3, float u)
+{
+	float u2 = u * u, u3 = u2 * u;
+	return (p1 * 2 + (p2 - p0) * u + (p0 * 2 - p1 * 5 + p2 * 4 - p3) * u2 + (p1 * 3 - p0 - p2 * 3 + p3) * u3) * 0.5f;
+}
+
+Camera* CameraPath::GetFrameCamera(int frame, Camera* base)
+{
+	if (!resolved) resolveKeys(base);
+
+	//keys k1 and k2 around the frame, with their neighbours k0 and k3 (clamped at the ends of the path)
+	int n = keys.size();
+	int k2 = 0;
+	while (k2 < n && keys[k2].frame <= frame) k2++;
+	int k1 = max(k2 - 1, 0);
+	k2 = min(k2, n - 1);
+	int k0 = max(k1 - 1, 0), k3 = min(k2 + 1, n - 1);
+
+	float u = keys[k2].frame > keys[k1].frame ? (float)(frame - keys[k1].frame) / (keys[k2].frame - keys[k1].frame) : 0.0f;
+	u = min(max(u, 0.0f), 1.0f);
+
+	Vector from = catmullRom(keys[k0].from, keys[k1].from, keys[k2].from, keys[k3].from, u);
+	Vector at = catmullRom(keys[k0].at, keys[k1].at, keys[k2].at, keys[k3].at, u);
+	Vector up = catmullRom(keys[k0].up, keys[k1].up, keys[k2].up, keys[k3].up, u);
+	float angle = keys[k1].angle + (keys[k2].angle - keys[k1].angle) * u;
+
+	return new Camera(from, at, up.normalize(), angle, base->GetNear(), base->GetFar(), base->GetResX(), base->GetResY(),
+		base->GetApertureRatio(), base->GetFocalRatio());
+}
+
+string CameraPath::getFrameFileName(int frame)
+{
+	char file_name[512];
+	snprintf(file_name, sizeof(file_name), output_pattern.c_str(), frame);
+	return file_name;
+}
@@ -0,0 +1,54 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+#include "camera.h"
+
+using namespace std;
+
+/*
+ Camera path for animations: one scene is parsed and its accelerator built once, and the frames are rendered
+ from cameras interpolated between keyframes. A path file has one statement per line; lines starting with '#' are skipped:
+	scene <scene.p3f>
+	frames <N>
+	out <file pattern>        printf pattern with the frame number, default frame_%04d.png
+	spp <N>
+	key <frame> [from x y z] [at x y z] [up x y z] [angle degrees]
+ A key keeps the values it does not set from the previous key (the first one from the scene camera). Positions are
+ interpolated with Catmull-Rom splines through the keys and the angle linearly.
+*/
+
+class CameraPath
+{
+public:
+	struct Key {
+		int frame;
+		Vector from, at, up;
+		float angle;
+		bool has_from, has_at, has_up, has_angle;
+	};
+
+	CameraPath();
+
+	bool Load(const char* path_file);
+	Camera* GetFrameCamera(int frame, Camera* base);   //camera of the frame with the resolution, lens and clipping of the base camera
+
+	const string& getScene() { return scene; }
+	const string& getOutputPattern() { return output_pattern; }
+	int getNumFrames() { return num_frames; }
+	int getSPP() { return spp; }   //0: keep the current SPP
+	string getFrameFileName(int frame);
+
+private:
+	void resolveKeys(Camera* base);
+
+	string scene;
+	string output_pattern;
+	int num_frames;
+	int spp;
+	vector<Key> keys;   //sorted by frame
+	bool resolved;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include "framebuffer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMEBUFFER_SSE
+#include <emmintrin.h>
+#endif
+
+void Framebuffer::Resize(int res_x_, int res_y_)
+{
+	res_x = res_x_;
+	res_y = res_y_;
+	sums.assign(3 * (size_t)res_x * res_y, 0.0f);
+	samples = 1;
+}
+
+// Same conversion as u8fromfloat, clamped below too: (mean * 255.99) truncated, 255 from 255 up
+void Framebuffer::Quantize(int first_row, int end_row, uint8_t* rgb)
+{
+	const float* in = &sums[3 * (size_t)first_row * res_x];
+	size_t n = 3 * (size_t)(end_row - first_row) * res_x, i = 0;
+	float scale = 1.0f / samples;
+
+#ifdef FRAMEBUFFER_SSE
+	//16 channels at a time: scale, clamp, truncate to 32-bit integers and pack them to bytes
+	__m128 s = _mm_set1_ps(scale), k = _mm_set1_ps(255.99f), zero = _mm_setzero_ps(), top = _mm_set1_ps(255.0f);
+	for (; i + 16 <= n; i += 16) {
+		__m128i q[4];
+		for (int j = 0; j < 4; j++) {
+			__m128 v = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4 * j), s), k);
+			q[j] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), top));
+		}
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+		_mm_storeu_si128((__m128i*)(rgb + i), bytes);
+	}
+#endif
+	for (; i < n; i++)
+		rgb[i] = (uint8_t)(int)std::min(std::max(in[i] * scale * 255.99f, 0.0f), 255.0f);
+}
+
+void Framebuffer::Resolve(int first_row, int end_row, float* linear)
+{
+	const float* in = &sums[3 * (size_t)first_row * res_x];
+	size_t n = 3 * (size_t)(end_row - first_row) * res_x;
+	float scale = 1.0f / samples;
+
+	for (size_t i = 0; i < n; i++)
+		linear[i] = in[i] * scale;
+}
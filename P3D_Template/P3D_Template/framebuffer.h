@@ -0,0 +1,35 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ Float accumulation framebuffer.
+ The renderer only adds linear colors into the sums of the pixels; the mean colors are resolved by separate passes
+ over whole rows once they are finished: the 8-bit quantization of the output image, the linear copy of the float
+ (PFM) images and the colors of the GL upload. The sums are divided by the samples of the buffer in those passes,
+ so further samples can be added to an image already displayed (progressive accumulation).
+*/
+
+class Framebuffer
+{
+public:
+	Framebuffer() : res_x(0), res_y(0), samples(1) {}
+
+	void Resize(int res_x_, int res_y_);   //clears the sums; reallocates only when the resolution changes
+	float* Row(int y) { return &sums[3 * (size_t)y * res_x]; }
+
+	void Quantize(int first_row, int end_row, uint8_t* rgb);   //8-bit mean colors of the rows, clamped
+	void Resolve(int first_row, int end_row, float* linear);   //mean colors of the rows
+
+	int res_x, res_y;
+	unsigned int samples;   //samples added to every pixel, the divisor of the sums
+
+private:
+	vector<float> sums;   //3 floats per pixel, bottom row first
+};
+
+#endif
@@ -1,6 +1,10 @@
 #include "rayAccelerator.h"
 #include "macros.h"
 #include "maths.h"
+#include "rayStats.h"
+#include <unordered_set>
+#include <climits>
+#include <cstdint>
 
 
 Grid::Grid(void) {}
@@ -40,7 +44,12 @@ void Grid::Build(vector<Object*>& objs) {
 	AABB grid_bbox = AABB(min, max);
 
 	//build the Grid BB and //insert scene objects in the Grid objects list
+	unbounded.clear();
 	for (Object* obj : objs) {
+		if (!obj->IsBounded()) {
+			unbounded.push_back(obj);
+			continue;
+		}
 		AABB o_bbox = obj->GetBoundingBox();
 		grid_bbox.extend(o_bbox);
 		this->addObject(obj);
@@ -67,34 +76,43 @@ void Grid::Build(vector<Object*>& objs) {
 
 	int cellCount = nx * ny * nz;
 
-	// set up a array to hold the objects stored in each cell
-	std::vector<Object*> obj_cell;
-	for (int i = 0; i < cellCount; i++) 
-		cells.push_back(obj_cell);   //each cell has an array with zero elements
-		
-	// insert the objects into the cells
-	for (auto &obj : objects) {   //vector iterator
-
-		AABB obb = obj->GetBoundingBox();
+	// count the objects of each cell, then place them in compressed rows
+	cell_start.assign(cellCount + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) {   //cell_start of each cell becomes its end, and goes down to its start as its objects are placed
+			for (int c = 1; c <= cellCount; c++)
+				cell_start[c] += cell_start[c - 1];
+			cell_objects.resize(cell_start[cellCount]);
+		}
 
-		// Compute indices of both cells that contain min and max coord of obj bbox
-		int ixmin = clamp((obb.min.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x), 0, nx - 1);
-		int iymin = clamp((obb.min.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y), 0, ny - 1);
-		int izmin = clamp((obb.min.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z), 0, nz - 1);
-		int ixmax = clamp((obb.max.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x), 0, nx - 1);
-		int iymax = clamp((obb.max.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y), 0, ny - 1);
-		int izmax = clamp((obb.max.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z), 0, nz - 1);
-
-		// add the object to the cells
-		for (int iz = izmin; iz <= izmax; iz++) 					// cells in z direction
-			for (int iy = iymin; iy <= iymax; iy++)					// cells in y direction
-				for (int ix = ixmin; ix <= ixmax; ix++) 			// cells in x direction
-					cells[ix + nx * iy + nx * ny * iz].push_back(obj);
+		// insert the objects into the cells, the last ones first so that each cell keeps the order of the objects
+		for (auto it = objects.rbegin(); it != objects.rend(); ++it) {
+			Object* obj = *it;
+			AABB obb = obj->GetBoundingBox();
+
+			// Compute indices of both cells that contain min and max coord of obj bbox
+			int ixmin = clamp((obb.min.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x), 0, nx - 1);
+			int iymin = clamp((obb.min.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y), 0, ny - 1);
+			int izmin = clamp((obb.min.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z), 0, nz - 1);
+			int ixmax = clamp((obb.max.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x), 0, nx - 1);
+			int iymax = clamp((obb.max.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y), 0, ny - 1);
+			int izmax = clamp((obb.max.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z), 0, nz - 1);
+
+			// add the object to the cells
+			for (int iz = izmin; iz <= izmax; iz++) 					// cells in z direction
+				for (int iy = iymin; iy <= iymax; iy++)					// cells in y direction
+					for (int ix = ixmin; ix <= ixmax; ix++) {			// cells in x direction
+						int cell = ix + nx * iy + nx * ny * iz;
+						if (pass == 0) cell_start[cell]++;
+						else cell_objects[--cell_start[cell]] = obj;
+					}
+		}
 	}
 
-	printf("\nGRID: total cells = %d, total objects = %d, ResX = %d, ResY = %d, ResZ = %d\n\n", cellCount, this->getNumObjects(), nx, ny, nz);
-	//Erase the vector that stores object pointers, but don't delete the objects
-	objects.erase(objects.begin(), objects.end());
+	printf("\nGRID: total cells = %d, total objects = %d, unbounded objects = %zu, ResX = %d, ResY = %d, ResZ = %d\n\n", cellCount,
+		this->getNumObjects(), unbounded.size(), nx, ny, nz);
+	//Release the vector that stores object pointers, but don't delete the objects
+	vector<Object*>().swap(objects);
 }
 
 //Setup function for Grid traversal according to Amanatides&Woo algorithm
@@ -253,25 +271,31 @@ bool Grid::Traverse(Ray& ray, Object **hitobject, Vector& hitpoint) {
 	int 	ix_step, iy_step, iz_step;
 	int 	ix_stop, iy_stop, iz_stop;
 
+	//the unbounded objects compete with those of every cell, and are the hit when the ray leaves the grid
+	float unboundedDistance = FLT_MAX;
+	Object* unboundedObj = closestUnbounded(unbounded, ray, unboundedDistance);
+
 	//Calculate the initial cell as well as the ray parameter increments per cell in the x, y, and z directions
 	if (!Init_Traverse(ray, ix, iy, iz, dtx, dty, dtz, tx_next, ty_next, tz_next, ix_step, iy_step, iz_step, ix_stop, iy_stop, iz_stop))
-		return false;   //ray does not intersect the Grid bounding box
+		return unboundedHit(unboundedObj, unboundedDistance, ray, hitobject, hitpoint);   //ray does not intersect the Grid bounding box
 
-	std::vector<Object*> objs;
 	float closestDistance;
-	Object* closestObj = NULL;
+	Object* closestObj;
 	float distance;
 	
 	while (true) {
-		objs = cells[ix + nx * iy + nx * ny * iz];
-
-		closestDistance = FLT_MAX;
-		if (objs.size() != 0) 
-			for (auto obj : objs) //intersect Ray with all objects and find the closest hit point(if any)
-				if (obj->intercepts(ray, distance) && distance < closestDistance) {
-					closestDistance = distance;
-					closestObj = obj;
-				}
+		STAT_INC(STAT_GRID_CELLS);
+		int cell = ix + nx * iy + nx * ny * iz;
+
+		closestDistance = unboundedDistance;
+		closestObj = unboundedObj;
+		for (unsigned int i = cell_start[cell]; i < cell_start[cell + 1]; i++) { //intersect Ray with all objects and find the closest hit point(if any)
+			Object* obj = cell_objects[i];
+			if (obj->intercepts(ray, distance) && distance < closestDistance) {
+				closestDistance = distance;
+				closestObj = obj;
+			}
+		}
 		
 		if (tx_next < ty_next && tx_next < tz_next) {
 			if (closestDistance < tx_next) {
@@ -281,7 +305,7 @@ bool Grid::Traverse(Ray& ray, Object **hitobject, Vector& hitpoint) {
 			}
 			tx_next += dtx;
 			ix += ix_step;
-			if (ix == ix_stop) return (false);
+			if (ix == ix_stop) return unboundedHit(unboundedObj, unboundedDistance, ray, hitobject, hitpoint);
 		}
 
 		else if (ty_next < tz_next) {
@@ -292,7 +316,7 @@ bool Grid::Traverse(Ray& ray, Object **hitobject, Vector& hitpoint) {
 				}
 				ty_next += dty;
 				iy += iy_step;
-				if (iy == iy_stop) return (false);
+				if (iy == iy_stop) return unboundedHit(unboundedObj, unboundedDistance, ray, hitobject, hitpoint);
 		}
 
 		else {
@@ -303,7 +327,7 @@ bool Grid::Traverse(Ray& ray, Object **hitobject, Vector& hitpoint) {
 			}
 			tz_next += dtz;
 			iz += iz_step;
-			if (iz == iz_stop) return (false);
+			if (iz == iz_stop) return unboundedHit(unboundedObj, unboundedDistance, ray, hitobject, hitpoint);
 		}
 		
 	}
@@ -315,6 +339,9 @@ bool Grid::Traverse(Ray& ray) {
 	double length = ray.direction.length(); //distance between light and intersection point
 	ray.direction.normalize();
 
+	if (anyUnbounded(unbounded, ray, length))
+		return true;
+
 	int ix, iy, iz;
 	double 	tx_next, ty_next, tz_next;
 	double dtx, dty, dtz;
@@ -323,21 +350,19 @@ bool Grid::Traverse(Ray& ray) {
 	int 	ix_stop, iy_stop, iz_stop;
 
 	/*Calculate the initial cell as well as the ray parameter increments per cell in the x, y, and z directions
-	Shadow ray always intersect the Grid bounding box. However due to rounding it may starts at the boundaries, which may result as no intersecting. Consider it as in shadow. */
+	Shadow rays from the unbounded objects, such as the floor, may start outside the Grid bounding box and miss it: nothing in the grid blocks them. */
 	if (!Init_Traverse(ray, ix, iy, iz, dtx, dty, dtz, tx_next, ty_next, tz_next, ix_step, iy_step, iz_step, ix_stop, iy_stop, iz_stop))
-		return true;
+		return false;
 
-	std::vector<Object*> objs;
 	float distance;
 
 	while (true) {
-		objs = cells[ix + nx * iy + nx * ny * iz];
-		if (objs.size() != 0) 
-			//intersect Ray with all objects of each cell
-			for (auto &obj : objs) {
-				if (obj->intercepts(ray, distance) && distance < length) 
-					return true;
-			}
+		STAT_INC(STAT_GRID_CELLS);
+		int cell = ix + nx * iy + nx * ny * iz;
+		//intersect Ray with all objects of each cell
+		for (unsigned int i = cell_start[cell]; i < cell_start[cell + 1]; i++)
+			if (cell_objects[i]->intercepts(ray, distance) && distance < length)
+				return true;
 		
 		if (tx_next < ty_next && tx_next < tz_next) {
 			tx_next += dtx;
@@ -359,3 +384,101 @@ bool Grid::Traverse(Ray& ray) {
 		}
 	}
 }
+
+// ---------------------------------------------quality report
+void printSizeHistogram(const char* title, const vector<unsigned int>& sizes)
+{
+	vector<unsigned int> buckets;
+	unsigned int max_size = 0;
+	double sum = 0;
+	for (unsigned int size : sizes) {
+		unsigned int b = 0;
+		while (b < 32 && size >= (1u << b)) b++;   //0 -> 0, 1 -> 1, 2-3 -> 2, 4-7 -> 3, ...
+		if (b >= buckets.size()) buckets.resize(b + 1, 0);
+		buckets[b]++;
+		if (size > max_size) max_size = size;
+		sum += size;
+	}
+
+	printf("%s: average %.2f, max %u\n", title, sizes.empty() ? 0.0 : sum / sizes.size(), max_size);
+	for (unsigned int b = 0; b < buckets.size(); b++) {
+		if (buckets[b] == 0) continue;
+		unsigned int low = b == 0 ? 0 : 1u << (b - 1), high = b == 0 ? 0 : (1u << b) - 1;
+		char range[32];
+		if (low == high) snprintf(range, sizeof(range), "%u", low);
+		else snprintf(range, sizeof(range), "%u-%u", low, high);
+		printf("  %-11s %10u  %5.1f%%\n", range, buckets[b], 100.0 * buckets[b] / sizes.size());
+	}
+}
+
+size_t Grid::GetMemory()
+{
+	return sizeof(Grid) + cell_start.capacity() * sizeof(unsigned int) + cell_objects.capacity() * sizeof(Object*) +
+		objects.capacity() * sizeof(Object*) + unbounded.capacity() * sizeof(Object*);
+}
+
+// The cells and their object references are counted as Build counts them, in double precision so that an exploding grid
+// does not overflow
+size_t Grid::EstimateMemory(vector<Object*>& objs, size_t& build_peak)
+{
+	build_peak = SIZE_MAX;
+	size_t n_bounded = 0;
+	AABB box = AABB(Vector(FLT_MAX, FLT_MAX, FLT_MAX), Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	for (Object* obj : objs) {
+		if (!obj->IsBounded()) continue;
+		AABB o_bbox = obj->GetBoundingBox();
+		box.extend(o_bbox);
+		n_bounded++;
+	}
+	if (n_bounded == 0) return SIZE_MAX;
+	box.min.x -= EPSILON; box.min.y -= EPSILON; box.min.z -= EPSILON;
+	box.max.x += EPSILON; box.max.y += EPSILON; box.max.z += EPSILON;
+
+	double wx = box.max.x - box.min.x, wy = box.max.y - box.min.y, wz = box.max.z - box.min.z;
+	double s = pow(n_bounded / (wx * wy * wz), 0.3333333);
+	double cx = floor(m * wx * s + 1), cy = floor(m * wy * s + 1), cz = floor(m * wz * s + 1);
+	if (!(cx * cy * cz < INT_MAX)) return SIZE_MAX;   //also for infinite or NaN extents
+	int ex = (int)cx, ey = (int)cy, ez = (int)cz;
+
+	double references = 0;
+	for (Object* obj : objs) {
+		if (!obj->IsBounded()) continue;
+		AABB obb = obj->GetBoundingBox();
+		int ixmin = clamp((obb.min.x - box.min.x) * ex / wx, 0, ex - 1);
+		int iymin = clamp((obb.min.y - box.min.y) * ey / wy, 0, ey - 1);
+		int izmin = clamp((obb.min.z - box.min.z) * ez / wz, 0, ez - 1);
+		int ixmax = clamp((obb.max.x - box.min.x) * ex / wx, 0, ex - 1);
+		int iymax = clamp((obb.max.y - box.min.y) * ey / wy, 0, ey - 1);
+		int izmax = clamp((obb.max.z - box.min.z) * ez / wz, 0, ez - 1);
+		references += (double)(ixmax - ixmin + 1) * (iymax - iymin + 1) * (izmax - izmin + 1);
+	}
+
+	double bytes = sizeof(Grid) + (cx * cy * cz + 1) * sizeof(unsigned int) + references * sizeof(Object*);
+	build_peak = (size_t)(bytes + n_bounded * sizeof(Object*));
+	return (size_t)bytes;
+}
+
+void Grid::PrintReport()
+{
+	vector<unsigned int> sizes;
+	unordered_set<Object*> distinct;
+	size_t references = 0, empty = 0;
+	size_t bytes = GetMemory();
+
+	size_t n_cells = cell_start.empty() ? 0 : cell_start.size() - 1;
+	for (size_t c = 0; c < n_cells; c++) {
+		unsigned int size = cell_start[c + 1] - cell_start[c];
+		sizes.push_back(size);
+		references += size;
+		if (size == 0) empty++;
+		distinct.insert(cell_objects.begin() + cell_start[c], cell_objects.begin() + cell_start[c + 1]);
+	}
+
+	printf("\nGRID REPORT: %d x %d x %d = %zu cells (m = %.2f)\n", nx, ny, nz, n_cells, m);
+	printf("Empty cells: %zu (%.1f%%)\n", empty, n_cells == 0 ? 0.0 : 100.0 * empty / n_cells);
+	printf("Object references: %zu for %zu objects, %zu duplicates (%.2f references per object)\n", references, distinct.size(),
+		references - distinct.size(), distinct.empty() ? 0.0 : (double)references / distinct.size());
+	printf("Unbounded objects: %zu, tested on every ray\n", unbounded.size());
+	printSizeHistogram("Objects per cell", sizes);
+	printf("Memory: %.1f KB\n", bytes / 1024.0);
+}
@@ -0,0 +1,181 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <sys/mman.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "hugePages.h"
+#include "sysinfo.h"
+
+bool hugePagesEnabled = false;
+
+typedef enum { BLOCK_MALLOC, BLOCK_HUGETLB, BLOCK_TRANSPARENT, BLOCK_NORMAL_PAGES } BlockKind;
+
+// Header in front of every block, one cache line so that the buffer stays 64-byte aligned
+struct BlockHeader {
+	void* base;   //of the mapping or of the malloc block
+	size_t length;   //mapped bytes
+	int kind;
+};
+
+static std::atomic<size_t> hugetlbBytes(0), transparentBytes(0), normalPageBytes(0);
+static std::atomic<unsigned int> fallbacks(0);   //large buffers the system gave no huge pages for
+
+static size_t roundUp(size_t bytes, size_t multiple) { return (bytes + multiple - 1) / multiple * multiple; }
+
+#ifdef _WIN32
+typedef enum { PRIVILEGE_NOT_TRIED, PRIVILEGE_ENABLED, PRIVILEGE_DENIED } PrivilegeState;
+static PrivilegeState lockMemoryPrivilege = PRIVILEGE_NOT_TRIED;
+
+// Large pages need SeLockMemoryPrivilege, which an account granted Lock Pages in Memory holds but has to enable in the
+// token of the process. AdjustTokenPrivileges succeeds without it, with ERROR_NOT_ALL_ASSIGNED.
+static bool enableLockMemoryPrivilege()
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		lockMemoryPrivilege = PRIVILEGE_DENIED;
+		return false;
+	}
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool ok = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	lockMemoryPrivilege = ok ? PRIVILEGE_ENABLED : PRIVILEGE_DENIED;
+	return ok;
+}
+#endif
+
+// Maps a large block: explicit huge pages, then transparent huge pages (Linux) or normal pages (Windows)
+static void* mapLarge(size_t bytes, size_t& length, int& kind)
+{
+#ifdef _WIN32
+	static SIZE_T large_page = GetLargePageMinimum() > 0 && enableLockMemoryPrivilege() ? GetLargePageMinimum() : 0;   //once
+	if (large_page > 0) {
+		length = roundUp(bytes, large_page);
+		void* p = VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (p != NULL) {
+			kind = BLOCK_HUGETLB;
+			return p;
+		}
+	}
+	length = bytes;
+	kind = BLOCK_NORMAL_PAGES;
+	return VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	length = roundUp(bytes, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		kind = BLOCK_HUGETLB;
+		return p;
+	}
+#endif
+	//mapped one huge page larger and trimmed to a huge page boundary, so that the kernel can back all of it
+	char* raw = (char*)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == (char*)MAP_FAILED) return NULL;
+	char* aligned = (char*)roundUp((size_t)raw, HUGE_PAGE_SIZE);
+	size_t head = aligned - raw;
+	if (head > 0) munmap(raw, head);
+	if (head < HUGE_PAGE_SIZE) munmap(aligned + length, HUGE_PAGE_SIZE - head);
+	kind = BLOCK_NORMAL_PAGES;
+#ifdef MADV_HUGEPAGE
+	if (madvise(aligned, length, MADV_HUGEPAGE) == 0) kind = BLOCK_TRANSPARENT;
+#endif
+	return aligned;
+#endif
+}
+
+static void unmapLarge(void* p, size_t length)
+{
+#ifdef _WIN32
+	(void)length;
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, length);
+#endif
+}
+
+static std::atomic<size_t>* kindBytes(int kind)
+{
+	return kind == BLOCK_HUGETLB ? &hugetlbBytes : kind == BLOCK_TRANSPARENT ? &transparentBytes : &normalPageBytes;
+}
+
+void* hugeAlloc(size_t bytes)
+{
+	BlockHeader header;
+	char* block;
+	bytes += HUGE_ALLOC_HEADER;
+
+	if (hugePagesEnabled && bytes >= HUGE_PAGE_MIN_BYTES) {
+		block = (char*)mapLarge(bytes, header.length, header.kind);
+		if (block == NULL) return NULL;
+		*kindBytes(header.kind) += header.length;
+		if (header.kind == BLOCK_NORMAL_PAGES) fallbacks++;
+		header.base = block;
+	}
+	else {
+		block = (char*)malloc(bytes + HUGE_ALLOC_HEADER - 1);
+		if (block == NULL) return NULL;
+		header.base = block;
+		header.length = bytes;
+		header.kind = BLOCK_MALLOC;
+		block = (char*)roundUp((size_t)block, HUGE_ALLOC_HEADER);
+	}
+
+	memcpy(block, &header, sizeof(header));
+	return block + HUGE_ALLOC_HEADER;
+}
+
+void hugeFree(void* p)
+{
+	if (p == NULL) return;
+	BlockHeader header;
+	memcpy(&header, (char*)p - HUGE_ALLOC_HEADER, sizeof(header));
+
+	if (header.kind == BLOCK_MALLOC)
+		free(header.base);
+	else {
+		*kindBytes(header.kind) -= header.length;
+		unmapLarge(header.base, header.length);
+	}
+}
+
+// Transparent huge pages of the whole process that the kernel has actually backed, in bytes; 0 when unknown
+static size_t anonHugePages()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	FILE* file = fopen("/proc/self/smaps_rollup", "r");
+	if (file == NULL) return 0;
+	char line[256];
+	size_t kb = 0;
+	while (fgets(line, sizeof(line), file))
+		if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) break;
+	fclose(file);
+	return kb * 1024;
+#endif
+}
+
+void printHugePageReport()
+{
+	if (!hugePagesEnabled) return;
+
+	const double mb = 1024.0 * 1024.0;
+	printf("\nHUGE PAGES: %.1f MB explicit, %.1f MB transparent (%.1f MB backed in the process), %.1f MB on normal pages (%u fallbacks); RSS %.1f MB, peak %.1f MB\n",
+		hugetlbBytes / mb, transparentBytes / mb, anonHugePages() / mb, normalPageBytes / mb, fallbacks.load(),
+		getCurrentRSS() / mb, getPeakRSS() / mb);
+#ifdef _WIN32
+	if (lockMemoryPrivilege == PRIVILEGE_DENIED)
+		printf("No large pages: the Lock Pages in Memory privilege (SeLockMemoryPrivilege) could not be enabled for this account\n");
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <stddef.h>
+#include <new>
+
+/*
+ Huge page backed allocation of the large buffers of the accelerators and the geometry (BVH nodes, object arrays, grid
+ cells and the arena blocks of the primitives), to cut the TLB misses of their random accesses on large scenes.
+ With hugePagesEnabled (-huge-pages), buffers of at least HUGE_PAGE_MIN_BYTES are mapped on their own: on Linux first
+ with explicit huge pages (MAP_HUGETLB, from the pool of vm.nr_hugepages), otherwise advised for transparent huge
+ pages (madvise MADV_HUGEPAGE); on Windows with large pages (MEM_LARGE_PAGES, needs the Lock Pages in Memory
+ privilege), otherwise as normal pages. Smaller buffers, and all of them when the option is off, come from malloc.
+ Every block records how it was allocated, so hugeFree takes any pointer of hugeAlloc.
+*/
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define HUGE_PAGE_MIN_BYTES (HUGE_PAGE_SIZE / 2)
+#define HUGE_ALLOC_HEADER 64   //bytes in front of every block; a buffer of N huge pages is asked for N pages less this
+
+extern bool hugePagesEnabled;
+
+void* hugeAlloc(size_t bytes);   //HUGE_ALLOC_HEADER-byte aligned; NULL when out of memory
+void hugeFree(void* p);
+
+//Bytes in explicit and transparent huge page mappings, buffers that fell back to normal pages, and the resident memory
+void printHugePageReport();
+
+// Standard allocator of the containers of large buffers
+template <class T>
+class HugePageAllocator
+{
+public:
+	typedef T value_type;
+
+	HugePageAllocator() {}
+	template <class U> HugePageAllocator(const HugePageAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		void* p = hugeAlloc(n * sizeof(T));
+		if (p == NULL) throw std::bad_alloc();
+		return (T*)p;
+	}
+	void deallocate(T* p, size_t) { hugeFree(p); }
+
+	template <class U> bool operator==(const HugePageAllocator<U>&) const { return true; }
+	template <class U> bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+#endif
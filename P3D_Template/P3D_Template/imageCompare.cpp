@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cfloat>
+#include <algorithm>
+#include <IL/il.h>
+#include "imageCompare.h"
+#include "textureCache.h"
+
+#define SSIM_WINDOW 8
+#define SSIM_STEP 4
+
+static float luminance(const uint8_t* p)
+{
+	return 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+}
+
+// Mean SSIM of the luminance over windows of SSIM_WINDOW x SSIM_WINDOW pixels, SSIM_STEP pixels apart
+static double ssim(const uint8_t* a, const uint8_t* b, int res_x, int res_y)
+{
+	const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+	vector<float> ya(res_x * res_y), yb(res_x * res_y);
+	for (int i = 0; i < res_x * res_y; i++) {
+		ya[i] = luminance(a + 3 * i);
+		yb[i] = luminance(b + 3 * i);
+	}
+
+	int window_x = min(SSIM_WINDOW, res_x), window_y = min(SSIM_WINDOW, res_y);
+	double sum = 0;
+	int n_windows = 0;
+	for (int y0 = 0; y0 + window_y <= res_y; y0 += SSIM_STEP)
+		for (int x0 = 0; x0 + window_x <= res_x; x0 += SSIM_STEP) {
+			double mean_a = 0, mean_b = 0, var_a = 0, var_b = 0, cov = 0;
+			int n = window_x * window_y;
+			for (int y = y0; y < y0 + window_y; y++)
+				for (int x = x0; x < x0 + window_x; x++) {
+					mean_a += ya[y * res_x + x];
+					mean_b += yb[y * res_x + x];
+				}
+			mean_a /= n;
+			mean_b /= n;
+			for (int y = y0; y < y0 + window_y; y++)
+				for (int x = x0; x < x0 + window_x; x++) {
+					double da = ya[y * res_x + x] - mean_a, db = yb[y * res_x + x] - mean_b;
+					var_a += da * da;
+					var_b += db * db;
+					cov += da * db;
+				}
+			var_a /= n - 1;
+			var_b /= n - 1;
+			cov /= n - 1;
+
+			sum += ((2 * mean_a * mean_b + c1) * (2 * cov + c2)) / ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+			n_windows++;
+		}
+	return n_windows > 0 ? sum / n_windows : 1.0;
+}
+
+ImageDiff compareImages(const uint8_t* a, const uint8_t* b, int res_x, int res_y, int tolerance)
+{
+	ImageDiff diff;
+	double squared_error = 0;
+	size_t bad_pixels = 0;
+	diff.max_diff = 0;
+
+	for (int i = 0; i < res_x * res_y; i++) {
+		bool bad = false;
+		for (int c = 0; c < 3; c++) {
+			int d = abs((int)a[3 * i + c] - (int)b[3 * i + c]);
+			squared_error += d * d;
+			if (d > diff.max_diff) diff.max_diff = d;
+			if (d > tolerance) bad = true;
+		}
+		if (bad) bad_pixels++;
+	}
+
+	double mse = squared_error / (3.0 * res_x * res_y);
+	diff.psnr = mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : DBL_MAX;
+	diff.ssim = ssim(a, b, res_x, res_y);
+	diff.bad_pixels = (double)bad_pixels / (res_x * res_y);
+	return diff;
+}
+
+// Binary PPM (P6, 8 bits), top row first in the file
+static bool loadPPM(const string& file_name, vector<uint8_t>& rgb, int& res_x, int& res_y)
+{
+	FILE* file = fopen(file_name.c_str(), "rb");
+	if (file == NULL) return false;
+
+	int max_value = 0;
+	bool ok = fscanf(file, "P6 %d %d %d", &res_x, &res_y, &max_value) == 3 && max_value == 255 && res_x > 0 && res_y > 0 && fgetc(file) != EOF;
+	if (ok) {
+		size_t row_bytes = 3 * res_x;
+		rgb.resize(row_bytes * res_y);
+		for (int y = res_y - 1; ok && y >= 0; y--)
+			ok = fread(rgb.data() + y * row_bytes, 1, row_bytes, file) == row_bytes;
+	}
+	fclose(file);
+	return ok;
+}
+
+bool loadImageRGB(const string& file_name, vector<uint8_t>& rgb, int& res_x, int& res_y)
+{
+	size_t dot = file_name.find_last_of('.');
+	if (dot != string::npos && (file_name.substr(dot) == ".ppm" || file_name.substr(dot) == ".PPM"))
+		return loadPPM(file_name, rgb, res_x, res_y);
+
+	lock_guard<mutex> devil_guard(devilLock);
+	ILuint image_id;
+	ilGenImages(1, &image_id);
+	ilBindImage(image_id);
+	ilEnable(IL_ORIGIN_SET);
+	ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+
+	bool ok = ilLoadImage(file_name.c_str()) && ilConvertImage(IL_RGB, IL_UNSIGNED_BYTE);
+	if (ok) {
+		res_x = ilGetInteger(IL_IMAGE_WIDTH);
+		res_y = ilGetInteger(IL_IMAGE_HEIGHT);
+		ILubyte* bytes = ilGetData();
+		rgb.assign(bytes, bytes + 3 * res_x * res_y);
+	}
+
+	ilDisable(IL_ORIGIN_SET);
+	ilDeleteImages(1, &image_id);
+	return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef IMAGE_COMPARE_H
+#define IMAGE_COMPARE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ Image comparison for the golden image regression mode: PSNR, SSIM and the pixels beyond a per-channel tolerance,
+ between 8-bit RGB images stored bottom row first like the render buffer.
+*/
+
+struct ImageDiff {
+	double psnr;   //dB, infinite for identical images
+	double ssim;   //mean SSIM of the luminance over 8x8 windows, 1 for identical images
+	int max_diff;   //largest difference of a channel
+	double bad_pixels;   //fraction of the pixels with a channel differing by more than the tolerance
+};
+
+ImageDiff compareImages(const uint8_t* a, const uint8_t* b, int res_x, int res_y, int tolerance);
+
+//Reads an image as 8-bit RGB, bottom row first: binary PPM directly, other formats through DevIL
+bool loadImageRGB(const string& file_name, vector<uint8_t>& rgb, int& res_x, int& res_y);
+
+#endif
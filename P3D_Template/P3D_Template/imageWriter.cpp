@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string.h>
+#include <IL/il.h>
+#include "imageWriter.h"
+#include "textureCache.h"
+#include "trace.h"
+#include "perfCounters.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+ImageFormat imageFormatFromName(const string& file_name)
+{
+	size_t dot = file_name.find_last_of('.');
+	string extension = dot == string::npos ? "" : file_name.substr(dot + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "ppm") return IMG_PPM;
+	if (extension == "pfm") return IMG_PFM;
+	return IMG_DEVIL;
+}
+
+/////////////////////////////////////////////////////////////////////// OUTPUT IMAGE
+
+OutputImage::OutputImage(const string& file_name_, int res_x_, int res_y_) :
+	file_name(file_name_), format(imageFormatFromName(file_name_)), res_x(res_x_), res_y(res_y_), hdr(NULL), writer(NULL), row_done(res_y_, false), rows_done(0)
+{
+	rgb = (uint8_t*)malloc(3 * res_x * res_y * sizeof(uint8_t));
+	if (rgb == NULL) exit(1);
+	if (format == IMG_PFM) {
+		hdr = (float*)malloc(3 * res_x * res_y * sizeof(float));
+		if (hdr == NULL) exit(1);
+	}
+}
+
+OutputImage::~OutputImage()
+{
+	free(rgb);
+	free(hdr);
+}
+
+size_t OutputImage::getBytes()
+{
+	return 3 * res_x * res_y * (sizeof(uint8_t) + (hdr ? sizeof(float) : 0));
+}
+
+void OutputImage::RowDone(int y)
+{
+	if (writer == NULL) {
+		row_done[y] = true;
+		return;
+	}
+	lock_guard<mutex> guard(writer->lock);
+	row_done[y] = true;
+	while (rows_done < res_y && row_done[rows_done])
+		rows_done++;
+	writer->changed.notify_all();
+}
+
+/////////////////////////////////////////////////////////////////////// IMAGE WRITER
+
+ImageWriter::ImageWriter(size_t max_queued_bytes) : queued_bytes(0), max_bytes(max_queued_bytes), stop(false), written(0), errors(0),
+	stream(NULL), stream_raw(false), stream_broken(false)
+{
+	worker = thread(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stop = true;
+	}
+	changed.notify_all();
+	worker.join();
+	if (stream) fclose(stream);
+}
+
+bool ImageWriter::OpenStream(const char* target, bool raw_rgb)
+{
+	FILE* file;
+	if (!strcmp(target, "-")) {
+		//the frames take over the standard output: the messages of the renderer go to stderr from now on
+		fflush(stdout);
+		int fd = dup(fileno(stdout));
+		dup2(fileno(stderr), fileno(stdout));
+		file = fd < 0 ? NULL : fdopen(fd, "wb");
+	}
+	else
+		file = fopen(target, "wb");   //a named pipe is opened as a file: this waits for the consumer
+
+	if (file == NULL) {
+		printf("Error opening the output stream %s\n", target);
+		return false;
+	}
+#ifdef _WIN32
+	_setmode(_fileno(file), _O_BINARY);
+#else
+	signal(SIGPIPE, SIG_IGN);   //a consumer that exits is reported as a write error
+#endif
+
+	lock_guard<mutex> guard(lock);
+	stream = file;
+	stream_raw = raw_rgb;
+	return true;
+}
+
+OutputImage* ImageWriter::BeginImage(const string& file_name, int res_x, int res_y)
+{
+	OutputImage* image = new OutputImage(file_name, res_x, res_y);
+	image->writer = this;
+
+	unique_lock<mutex> guard(lock);
+	//back-pressure: an image is always accepted when the queue is empty, so that one image larger than the limit still goes through
+	changed.wait(guard, [&] { return queue.empty() || queued_bytes + image->getBytes() <= max_bytes; });
+	queue.push_back(image);
+	queued_bytes += image->getBytes();
+	changed.notify_all();
+	return image;
+}
+
+void ImageWriter::Flush()
+{
+	unique_lock<mutex> guard(lock);
+	changed.wait(guard, [&] { return queue.empty(); });
+}
+
+void ImageWriter::waitRows(OutputImage* image, int rows)
+{
+	unique_lock<mutex> guard(lock);
+	changed.wait(guard, [&] { return image->rows_done >= rows; });
+}
+
+void ImageWriter::run()
+{
+	traceThreadName("image writer");
+	while (true) {
+		OutputImage* image;
+		{
+			unique_lock<mutex> guard(lock);
+			changed.wait(guard, [&] { return stop || !queue.empty(); });
+			if (queue.empty()) return;
+			image = queue.front();
+		}
+
+		bool ok;
+		{
+			TraceSpan span("write image", "output");   //rows written as they are rendered: includes the waits for them
+			PerfScope perf(PERF_ENCODE);
+			ok = write(image);
+		}
+		if (!ok && !stream) printf("Error saving Image file %s\n", image->file_name.c_str());
+
+		{
+			lock_guard<mutex> guard(lock);
+			queue.pop_front();
+			queued_bytes -= image->getBytes();
+			ok ? written++ : errors++;
+		}
+		changed.notify_all();
+		delete image;
+	}
+}
+
+bool ImageWriter::write(OutputImage* image)
+{
+	if (stream) return writeStream(image);
+
+	switch (image->format) {
+	case IMG_PPM: return writePPM(image);
+	case IMG_PFM: return writePFM(image);
+	default: return writeDevIL(image);
+	}
+}
+
+// Binary PPM, top row first: each row is written at its place in the file as soon as it is rendered
+bool ImageWriter::writePPM(OutputImage* image)
+{
+	FILE* file = fopen(image->file_name.c_str(), "wb");
+	if (file == NULL) {
+		waitRows(image, image->res_y);
+		return false;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", image->res_x, image->res_y);
+	long header = ftell(file);
+	size_t row_bytes = 3 * image->res_x;
+	bool ok = true;
+
+	for (int y = 0; y < image->res_y; y++) {
+		waitRows(image, y + 1);
+		if (ok) {
+			fseek(file, header + (long)((image->res_y - 1 - y) * row_bytes), SEEK_SET);
+			ok = fwrite(image->rgb + y * row_bytes, 1, row_bytes, file) == row_bytes;
+		}
+	}
+	return fclose(file) == 0 && ok;
+}
+
+// PFM: little-endian float RGB, bottom row first like the renderer, so the rows are appended as they are rendered
+bool ImageWriter::writePFM(OutputImage* image)
+{
+	FILE* file = fopen(image->file_name.c_str(), "wb");
+	if (file == NULL) {
+		waitRows(image, image->res_y);
+		return false;
+	}
+
+	fprintf(file, "PF\n%d %d\n-1.0\n", image->res_x, image->res_y);
+	size_t row_floats = 3 * image->res_x;
+	bool ok = true;
+
+	for (int y = 0; y < image->res_y; y++) {
+		waitRows(image, y + 1);
+		if (ok) ok = fwrite(image->hdr + y * row_floats, sizeof(float), row_floats, file) == row_floats;
+	}
+	return fclose(file) == 0 && ok;
+}
+
+bool ImageWriter::writeDevIL(OutputImage* image)
+{
+	ILuint ImageId;
+
+	waitRows(image, image->res_y);
+
+	lock_guard<mutex> devil_guard(devilLock);
+	ilEnable(IL_FILE_OVERWRITE);
+	ilGenImages(1, &ImageId);
+	ilBindImage(ImageId);
+
+	ilTexImage(image->res_x, image->res_y, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, image->rgb /*Texture*/);
+	ilSaveImage(image->file_name.c_str());
+
+	ilDisable(IL_FILE_OVERWRITE);
+	ilDeleteImages(1, &ImageId);
+	return ilGetError() == IL_NO_ERROR;
+}
+
+// One frame on the stream, top row first, straight from the render buffer
+bool ImageWriter::writeStream(OutputImage* image)
+{
+	waitRows(image, image->res_y);
+	if (stream_broken) return false;
+
+	size_t row_bytes = 3 * image->res_x;
+	bool ok = stream_raw || fprintf(stream, "P6\n%d %d\n255\n", image->res_x, image->res_y) > 0;
+	for (int y = image->res_y - 1; ok && y >= 0; y--)
+		ok = fwrite(image->rgb + y * row_bytes, 1, row_bytes, stream) == row_bytes;
+	ok = ok && fflush(stream) == 0;
+
+	if (!ok) {
+		stream_broken = true;
+		fprintf(stderr, "Error writing to the output stream: the consumer has closed it\n");
+	}
+	return ok;
+}
@@ -0,0 +1,95 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+using namespace std;
+
+/*
+ Asynchronous image output.
+ The renderer asks the ImageWriter for an OutputImage, renders into its buffers and marks every row as done; the
+ images are written in order by a background thread, so encoding overlaps the rendering of the next image.
+ PPM and PFM files are written row by row while the image is still being rendered; the other formats are encoded by
+ DevIL once the image is complete. The memory of the queued images is bounded: BeginImage waits while it is exceeded.
+ With a stream open, the images are not written to their files but sent, as binary PPM or raw RGB frames, to stdout
+ or a named pipe for a video encoder; a slow consumer blocks the writer, and so the renderer through BeginImage.
+*/
+
+typedef enum { IMG_DEVIL, IMG_PPM, IMG_PFM } ImageFormat;
+
+//PPM (8-bit binary P6) and PFM (linear float RGB) by the extension of the file name, any other extension by DevIL
+ImageFormat imageFormatFromName(const string& file_name);
+
+class ImageWriter;
+
+class OutputImage
+{
+public:
+	OutputImage(const string& file_name_, int res_x_, int res_y_);
+	~OutputImage();
+
+	void RowDone(int y);   //rows may finish in any order; they are written from the bottom of the image as they complete
+
+	string file_name;
+	ImageFormat format;
+	int res_x, res_y;
+	uint8_t* rgb;   //quantized colors, 3 bytes per pixel, bottom row first
+	float* hdr;     //linear colors before clamping and quantization, only for the PFM format
+
+	size_t getBytes();
+
+private:
+	friend class ImageWriter;
+
+	ImageWriter* writer;   //NULL while the image is not queued
+	vector<bool> row_done;
+	int rows_done;   //rows complete from the bottom of the image
+};
+
+class ImageWriter
+{
+public:
+	ImageWriter(size_t max_queued_bytes);
+	~ImageWriter();   //writes the images still queued
+
+	//Sends the images to target ("-" for stdout, which then prints to stderr) instead of their files
+	bool OpenStream(const char* target, bool raw_rgb);
+
+	OutputImage* BeginImage(const string& file_name, int res_x, int res_y);
+	void Flush();   //waits until all the queued images are written
+
+	unsigned int getWritten() { return written; }
+	unsigned int getErrors() { return errors; }
+
+private:
+	friend class OutputImage;
+
+	void run();
+	void waitRows(OutputImage* image, int rows);
+	bool write(OutputImage* image);
+	bool writePPM(OutputImage* image);
+	bool writePFM(OutputImage* image);
+	bool writeDevIL(OutputImage* image);
+	bool writeStream(OutputImage* image);
+
+	mutex lock;
+	condition_variable changed;
+	deque<OutputImage*> queue;   //images being rendered or written, in output order
+	size_t queued_bytes, max_bytes;
+	bool stop;
+	unsigned int written, errors;
+	thread worker;
+
+	FILE* stream;
+	bool stream_raw;
+	bool stream_broken;
+};
+
+#endif
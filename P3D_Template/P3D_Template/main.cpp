@@ -13,6 +13,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <conio.h>
 
 #include <GL/glew.h>
@@ -23,6 +26,22 @@
 #include "maths.h"
 #include "sampler.h"
 #include "rayAccelerator.h"
+#include "batch.h"
+#include "cameraPath.h"
+#include "imageWriter.h"
+#include "bench.h"
+#include "sysinfo.h"
+#include "rayStats.h"
+#include "rayCapture.h"
+#include "trace.h"
+#include "imageCompare.h"
+#include "perfCounters.h"
+#include "sceneGenerator.h"
+#include "allocCounter.h"
+#include "framebuffer.h"
+#include "hugePages.h"
+#include "renderer.h"
+#include "modes.h"
 
 #define CAPTION "Whitted Ray-Tracer"
 
@@ -36,11 +55,20 @@
 unsigned int FrameCount = 0;
 
 // Accelerators
-typedef enum {NONE, GRID_ACC, BVH_ACC} Accelerator;
 Accelerator Accel_Struct = GRID_ACC;
 Grid* grid_ptr;
 BVH* bvh_ptr;
 
+//Accelerator parameters (0: the default of the accelerator): maximum objects per BVH leaf and cell density factor of the grid
+int bvhThreshold = 0;
+float gridDensity = 0;
+
+//Memory budget of the accelerator in bytes (0: none), given in MB by -mem-budget. With a budget, the headless, batch
+//and animation modes estimate the memory of each accelerator before building it and build the fastest one that fits,
+//instead of Accel_Struct; the grid is also tried at halved densities down to budgetMinGridDensity
+size_t memoryBudget = 0;
+float budgetMinGridDensity = 0.25f;
+
 // Current Camera Position
 float camX, camY, camZ;
 
@@ -71,16 +99,88 @@ bool softShadows = false;
 bool fuzzyReflections = false;
 
 bool P3F_scene = true; //choose between P3F scene or a built-in random scene
-float sppSquared = sqrt(SPP);
+
+//Out-of-core mode: meshes with at least outOfCoreMinFaces faces are paged from disk and at most pageBudgetMB are kept in memory
+bool outOfCore = false;
+size_t pageBudgetMB = 256;
+unsigned int outOfCoreMinFaces = 100000;
+
+//Compact meshes: the triangles of meshes with at least compactMinFaces faces take 64 bytes instead of 136 (0: never)
+unsigned int compactMinFaces = 10000;
+
+//Samples per pixel: SPP by default, can be changed with -spp or per batch job. The samples are taken on a
+//sppSquared x sppSquared grid, so spp is always a square number; set it with setSPP
+int spp = SPP;
+int sppSquared = (int)sqrt(SPP);
+
+// Rounds n to the nearest square number of samples, reporting it when it changes
+void setSPP(int n)
+{
+	sppSquared = max((int)(sqrt((double)max(n, 1)) + 0.5), 1);
+	spp = sppSquared * sppSquared;
+	if (spp != n)
+		printf("spp %d rounded to %d (%d x %d samples per pixel)\n", n, spp, sppSquared, sppSquared);
+}
+
+//Headless batch mode: job list file ("-" for stdin) and number of scenes kept parsed between jobs
+const char* batchFile = NULL;
+unsigned int sceneCacheSize = 4;
+
+//Rendering threads (0: one per core): they share the rows of an image, or render whole frames in the animation mode
+unsigned int numThreads = 0;
+
+//Animation mode: camera path file
+const char* cameraPathFile = NULL;
+
+//Headless modes of modes.cpp, which measure or check the renderer: benchmark, golden image regression and accelerator report
+bool benchmark = false;
+bool goldenRegression = false;
+bool accelReport = false;
+
+//Heatmap mode (needs RAY_STATS): instead of the shaded color, each pixel shows the BVH nodes visited, grid cells stepped or
+//primitive tests per sample of its whole ray tree (of the primary ray only with heatmapPrimary), through a false-color ramp
+//up to heatmapMax (0: the maximum of the image)
+typedef enum { HEAT_OFF, HEAT_NODES, HEAT_CELLS, HEAT_TESTS } HeatmapMode;
+HeatmapMode heatmapMode = HEAT_OFF;
+bool heatmapPrimary = false;
+float heatmapMax = 0;
+
+//Synthetic scene: with a count, the headless and GL modes render a scene generated with genParams instead of a P3F file,
+//and with genOutput it is written as a P3F file instead. The benchmark generates its "gen:<count>" scenes with genParams
+SceneGenParams genParams = { 0, GEN_UNIFORM, { 1, 0, 0 }, 1, 512, 512 };
+const char* genOutput = NULL;
+
+//Ray capture: the rays traced for the image of the headless mode are recorded to captureFile. The replay mode traces the
+//rays of replayFile through each accelerator of benchAccels with each thread count of benchThreads, without shading
+const char* captureFile = NULL;
+RayCapture* rayCapture = NULL;
+const char* replayFile = NULL;
+
+//Rays traced (primary, secondary and shadow rays), counted per thread and added up when the thread finishes its rows
+std::atomic<unsigned long long> raysTraced(0);
+thread_local unsigned long long rayCounter = 0;
 
 // Points defined by 2 attributes: positions which are stored in vertices array and colors which are stored in colors array
 float *colors;
 float *vertices;
 int size_vertices;
 int size_colors;
+Framebuffer displayFramebuffer;  // sums of the image drawn by OpenGL, resolved into colors before each upload
+
+//Output of the headless modes: images are written by a background thread, and at most outputQueueMB of them are queued
+ImageWriter* imageWriter = NULL;
+const char* outputFile = "RT_Output.png";
+size_t outputQueueMB = 256;
+
+//Timeline trace (Chrome trace-event JSON) of the run, written at exit
+const char* traceFile = NULL;
+
+//Hardware performance counters (Linux) around the accelerator build, render and image encode, reported with the timings
+bool perfCounting = false;
 
-//Array of Pixels to be stored in a file by using DevIL library
-uint8_t *img_Data;
+//Streaming: the images are sent to streamTarget ("-" for stdout, or a named pipe) as PPM frames, or raw RGB frames, instead of files
+const char* streamTarget = NULL;
+bool streamRawRGB = false;
 
 GLfloat m[16];  //projection matrix initialized by ortho function
 
@@ -99,31 +199,35 @@ int dofDir = -1;
 
 Color rayTracing(Ray ray, int depth, float ior_1);
 void RayTraversal(int objectsN, Object*& currentObj, Ray& ray, float& dist, float& minDist, Object*& nearestObj);
-void antiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray);
-void notAntiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray);
-void hardShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray);
-void Reflection(Vector& normal, Ray& ray, Vector& actualHitPoint, Vector& hitPoint, Color& reflectionColor, int depth, float ior_1, Object* obj, float reflectionIndex);
+void antiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray);
+void notAntiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray);
+void hardShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray);
+void Reflection(Vector& normal, Ray& ray, Vector& actualHitPoint, Vector& hitPoint, Color& reflectionColor, int depth, float ior_1, Material& material);
 bool rayTraverseShadows(int objectN, Object*& currentObj, Ray& ray, float& dist, float lineLength);
 
 
 bool isPointObstructed(Vector& fromPoint, Vector& toPoint)
 {
+	rayCounter++;
+	STAT_INC(STAT_SHADOW_RAYS);
 	int objectN = scene->getNumObjects();
 	Vector line = toPoint - fromPoint;
 	float lineLength = line.length();
 
 	Ray ray = Ray(fromPoint, line);
+	if (rayCapture) rayCapture->Record(ray, lineLength, RAY_SHADOW);
 	Object* currentObj;
 	float dist;
 	if (Accel_Struct == NONE)
 	{
+		ray.direction.normalize();   //the hit distances are compared with the length of the line, as in the Grid and the BVH
 		return rayTraverseShadows(objectN, currentObj, ray, dist, lineLength);
 	}
 	else if (Accel_Struct == GRID_ACC)
 	{
 		return grid_ptr->Traverse(ray);
 	}
-	else if (Accel_Struct == BVH_ACC)
+	else if (Accel_Struct == BVH_ACC || Accel_Struct == QBVH_ACC)
 	{
 		return bvh_ptr->Traverse(ray);
 	}
@@ -146,19 +250,19 @@ bool rayTraverseShadows(int objectN, Object*& currentObj, Ray& ray, float& dist,
 	return false;
 }
 
-Color calculateColor(Light* light, Object* obj, Vector& L, Vector& normal, Vector& eyeDir)
+Color calculateColor(Light* light, Material& material, Vector& L, Vector& normal, Vector& eyeDir)
 {
 	Vector v, h;
 	v = eyeDir * (-1);
 	h = (L + v).normalize();
 	Vector myNormal = normal;
 
-	Color specular = (light->color * obj->GetMaterial()->GetSpecColor()) * obj->GetMaterial()->GetSpecular() *pow(max(h * normal,0), obj->GetMaterial()->GetShine());
-	Color diffuse = (light->color * obj->GetMaterial()->GetDiffColor()) *  obj->GetMaterial()->GetDiffuse() * max((L * normal), 0);
+	Color specular = (light->color * material.GetSpecColor()) * material.GetSpecular() *pow(max(h * normal,0), material.GetShine());
+	Color diffuse = (light->color * material.GetDiffColor()) *  material.GetDiffuse() * max((L * normal), 0);
 	return diffuse + specular;
 }
 
-Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,int depth)
+Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray& ray, float ior_1,int depth)
 {
 	
 	int lightN = scene->getNumLights();
@@ -171,6 +275,7 @@ Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,
 	Vector L,v,h;
 	float refractionIndex;
 	bool outsideIn = normal * ray.direction <= 0;
+	Material& material = scene->GetMaterial(obj->GetMaterialId());   //looked up once per hit
 
 
 	for (int i = 0; i < lightN; i++)
@@ -191,13 +296,13 @@ Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,
 			}
 
 			if(!softShadows)
-			hardShadows(currentLight, actualHitPoint, L, normal, lightSum, obj, shadingNormal, ray);
+			hardShadows(currentLight, actualHitPoint, L, normal, lightSum, material, shadingNormal, ray);
 			else
 			{
 				if(withAntialiasing)
-					antiAliasedSoftShadows(currentLight, actualHitPoint, L, normal, lightSum, obj, shadingNormal, ray);
+					antiAliasedSoftShadows(currentLight, actualHitPoint, L, normal, lightSum, material, shadingNormal, ray);
 				else
-					notAntiAliasedSoftShadows(currentLight, actualHitPoint, L, normal, lightSum, obj, shadingNormal, ray);
+					notAntiAliasedSoftShadows(currentLight, actualHitPoint, L, normal, lightSum, material, shadingNormal, ray);
 			}
 
 		}
@@ -210,14 +315,13 @@ Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,
 	if (depth > MAX_DEPTH)
 		return objectColor;
 
-	float reflectionIndex = obj->GetMaterial()->GetReflection();
-	if ( reflectionIndex > 0)
+	if (material.GetReflection() > 0)
 	{
-		Reflection(normal, ray, actualHitPoint, hitPoint, reflectionColor, depth, ior_1, obj, reflectionIndex);
+		Reflection(normal, ray, actualHitPoint, hitPoint, reflectionColor, depth, ior_1, material);
 	}
 
-	refractionIndex = obj->GetMaterial()->GetRefrIndex(); 
-	if (obj->GetMaterial()->GetTransmittance() > 0)
+	refractionIndex = material.GetRefrIndex(); 
+	if (material.GetTransmittance() > 0)
 	{
 		float fromIor;
 		float toIor;
@@ -274,6 +378,7 @@ Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,
 
 
 		Ray refractionRay =  Ray(actualHitPoint, refractionDirection);
+		STAT_INC(STAT_REFRACTION_RAYS);
 		refractionColor = rayTracing(refractionRay, depth+1, toIor);
 		refractionColor.clamp();
 
@@ -286,7 +391,7 @@ Color trace(Object* obj, Vector& hitPoint, Vector& normal, Ray ray, float ior_1,
 	return (objectColor + (reflectionColor* attenuation) + (refractionColor *(1- attenuation))).clamp();
 }
 
-void Reflection(Vector& normal, Ray& ray, Vector& actualHitPoint, Vector& hitPoint, Color& reflectionColor, int depth, float ior_1, Object* obj, float reflectionIndex)
+void Reflection(Vector& normal, Ray& ray, Vector& actualHitPoint, Vector& hitPoint, Color& reflectionColor, int depth, float ior_1, Material& material)
 {
 	Vector myNormal = normal;
 	Vector S, Sdir;
@@ -310,60 +415,57 @@ void Reflection(Vector& normal, Ray& ray, Vector& actualHitPoint, Vector& hitPoi
 	}
 
 	Ray newRay = Ray(actualHitPoint, newDir);
+	STAT_INC(STAT_REFLECTION_RAYS);
 	reflectionColor = rayTracing(newRay, depth + 1, ior_1);
-	if (obj->GetMaterial()->GetTransmittance() == 0)
+	if (material.GetTransmittance() == 0)
 	{
-		reflectionColor = reflectionColor * reflectionIndex * obj->GetMaterial()->GetSpecColor();
+		reflectionColor = reflectionColor * material.GetReflection() * material.GetSpecColor();
 	}
 	reflectionColor.clamp();
 }
 
-void hardShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray)
+void hardShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray)
 {
 	Vector sample = currentLight->position;
 
 	if (!isPointObstructed(actualHitPoint, sample) && L * normal > 0)
 	{
-		lightSum += calculateColor(currentLight, obj, L, shadingNormal, ray.direction);
+		lightSum += calculateColor(currentLight, material, L, shadingNormal, ray.direction);
 	}
 }
 
-void antiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray)
+void antiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray)
 {
 	Vector sample = currentLight->position + Vector(0, 1, 0) * rand_float() + Vector(1, 0, 0) * rand_float();
 
 	if (!isPointObstructed(actualHitPoint, sample) && L * normal > 0)
 	{
-		lightSum += calculateColor(currentLight, obj, L, shadingNormal, ray.direction);
+		lightSum += calculateColor(currentLight, material, L, shadingNormal, ray.direction);
 	}
 }
 
-void notAntiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Object* obj, Vector& shadingNormal, Ray& ray)
+void notAntiAliasedSoftShadows(Light* currentLight, Vector& actualHitPoint, Vector& L, Vector& normal, Color& lightSum, Material& material, Vector& shadingNormal, Ray& ray)
 {
 	Vector sample = currentLight->position + Vector(0, 1, 0) * rand_float() + Vector(1, 0, 0) * rand_float();
-	Color originalColor = currentLight->color;
-	currentLight->color = currentLight->color * (1.0f/(sppSquared * sppSquared));
+	float sampleWeight = 1.0f / (sppSquared * sppSquared);  //the light is shared by all the rendering threads, so it is not scaled in place
 	for(int x = 0; x < sppSquared; x++)
 		for (int y = 0; y < sppSquared; y++)
 		{
 			sample = currentLight->position + Vector(0, 1, 0) * ((x + rand_float())/sppSquared) + Vector(1, 0, 0) * ((y + rand_float()) / sppSquared);
 			if (!isPointObstructed(actualHitPoint, sample) && L * normal > 0)
 			{
-				lightSum += calculateColor(currentLight, obj, L, shadingNormal, ray.direction);
+				lightSum += calculateColor(currentLight, material, L, shadingNormal, ray.direction) * sampleWeight;
 			}
 		}
-
-	currentLight->color = originalColor;
 }
 
-Color rayTracing( Ray ray, int depth, float ior_1)  //index of refraction of medium 1 where the ray is travelling
+// Closest object hit by the ray (NULL if none) and the hit point
+Object* closestHit(Ray& ray, Vector& hitPoint)
 {
-	
 	float dist ;
 	int objectsN = scene->getNumObjects();
 	Object* currentObj;
 	Object* nearestObj = NULL;
-	Vector normal, hitPoint;
 	float minDist = numeric_limits<float>::max();
 	
 	
@@ -376,12 +478,21 @@ Color rayTracing( Ray ray, int depth, float ior_1)  //index of refraction of med
 	{
 		grid_ptr->Traverse(ray, &nearestObj, hitPoint);
 	}
-	else if (Accel_Struct == BVH_ACC)
+	else if (Accel_Struct == BVH_ACC || Accel_Struct == QBVH_ACC)
 	{
 		bvh_ptr->Traverse(ray, &nearestObj, hitPoint);
 	}
+	return nearestObj;
+}
 
+Color rayTracing( Ray ray, int depth, float ior_1)  //index of refraction of medium 1 where the ray is travelling
+{
+	rayCounter++;
+	if (depth == 1) STAT_INC(STAT_PRIMARY_RAYS);
+	if (rayCapture) rayCapture->Record(ray, FLT_MAX, depth == 1 ? RAY_PRIMARY : RAY_SECONDARY);
 
+	Vector normal, hitPoint;
+	Object* nearestObj = closestHit(ray, hitPoint);
 
 	if(nearestObj != NULL)
 	{
@@ -389,7 +500,7 @@ Color rayTracing( Ray ray, int depth, float ior_1)  //index of refraction of med
 	
 	    return trace(nearestObj, hitPoint, normal, ray,ior_1, depth);
 	}
-	if(!P3F_scene)
+	if(!scene->GetSkyBoxFlg())  //random scenes, and P3F scenes without env
 		return scene->GetBackgroundColor();
 //	return scene->GetBackgroundColor();
 	return scene->GetSkyboxColor(ray);
@@ -517,9 +628,9 @@ void createBufferObjects()
 	glGenBuffers(2, VboId);
 	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
 
-	/* S� se faz a aloca��o dos arrays glBufferData (NULL), e o envio dos pontos para a placa gr�fica
-	� feito na drawPoints com GlBufferSubData em tempo de execu��o pois os arrays s�o GL_DYNAMIC_DRAW */
-	glBufferData(GL_ARRAY_BUFFER, size_vertices, NULL, GL_DYNAMIC_DRAW);
+	/* The positions of the points never change and are sent once; the colors are sent in drawPoints with
+	glBufferSubData at run time, so their array is GL_DYNAMIC_DRAW */
+	glBufferData(GL_ARRAY_BUFFER, size_vertices, vertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(VERTEX_COORD_ATTRIB);
 	glVertexAttribPointer(VERTEX_COORD_ATTRIB, 2, GL_FLOAT, 0, 0, 0);
 	
@@ -556,14 +667,19 @@ void drawPoints()
 	glBindVertexArray(VaoId);
 	glUseProgram(ProgramId);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size_vertices, vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size_colors, colors);
+	{
+		TraceSpan span("GL upload", "display");
+		displayFramebuffer.Resolve(0, RES_Y, colors);
+		glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size_colors, colors);
+	}
 
-	glUniformMatrix4fv(UniformId, 1, GL_FALSE, m);
-	glDrawArrays(GL_POINTS, 0, RES_X*RES_Y);
-	glFinish();
+	{
+		TraceSpan span("GL draw", "display");
+		glUniformMatrix4fv(UniformId, 1, GL_FALSE, m);
+		glDrawArrays(GL_POINTS, 0, RES_X*RES_Y);
+		glFinish();
+	}
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -572,23 +688,6 @@ void drawPoints()
 	checkOpenGLError("ERROR: Could not draw scene.");
 }
 
-ILuint saveImgFile(const char *filename) {
-	ILuint ImageId;
-
-	ilEnable(IL_FILE_OVERWRITE);
-	ilGenImages(1, &ImageId);
-	ilBindImage(ImageId);
-
-	ilTexImage(RES_X, RES_Y, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, img_Data /*Texture*/);
-	ilSaveImage(filename);
-
-	ilDisable(IL_FILE_OVERWRITE);
-	ilDeleteImages(1, &ImageId);
-	if (ilGetError() != IL_NO_ERROR)return ilGetError();
-
-	return IL_NO_ERROR;
-}
-
 /////////////////////////////////////////////////////////////////////// CALLBACKS
 
 void timer(int value)
@@ -602,32 +701,103 @@ void timer(int value)
 	glutTimerFunc(1000, timer, 0);
 }
 
-// Render function by primary ray casting from the eye towards the scene's objects
+/////////////////////////////////////////////////////////////////////// HEATMAP
 
-void renderScene()
+// Current value of the heatmap counters of the calling thread
+unsigned long long heatmapCount()
 {
-	int index_pos=0;
-	int index_col=0;
-	unsigned int counter = 0;
+#ifdef RAY_STATS
+	unsigned long long* c = threadStats.counters;
+	switch (heatmapMode) {
+	case HEAT_NODES: return c[STAT_BVH_NODES];
+	case HEAT_CELLS: return c[STAT_GRID_CELLS];
+	case HEAT_TESTS: return c[STAT_SPHERE_TESTS] + c[STAT_TRIANGLE_TESTS] + c[STAT_PLANE_TESTS] + c[STAT_BOX_TESTS];
+	default: return 0;
+	}
+#else
+	return 0;
+#endif
+}
 
-	dofMod += 1*dofDir;
-	if (dofMod == 6)
-		dofDir = -1;
-	if (dofMod <= 1)
-		dofDir = 1;
+// Color of a pixel sample; in the primary heatmap only the primary ray is traversed
+Color samplePixel(Ray& ray)
+{
+	if (heatmapPrimary && heatmapMode != HEAT_OFF) {
+		Vector hitPoint;
+		closestHit(ray, hitPoint);
+		return Color(0, 0, 0);
+	}
+	return rayTracing(ray, 1, 1.0);
+}
 
-	
+// False-color ramp: blue, cyan, green, yellow and red for values from 0 to 1
+Color heatRamp(float v)
+{
+	const float stops[5][3] = { {0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0} };
+	v = min(max(v, 0.0f), 1.0f) * 4;
+	int i = min((int)v, 3);
+	float f = v - i;
+	return Color(stops[i][0] + (stops[i + 1][0] - stops[i][0]) * f,
+		stops[i][1] + (stops[i + 1][1] - stops[i][1]) * f,
+		stops[i][2] + (stops[i + 1][2] - stops[i][2]) * f);
+}
 
-	if (drawModeEnabled) {
-		glClear(GL_COLOR_BUFFER_BIT);
-		scene->GetCamera()->SetEye(Vector(camX, camY, camZ));  //Camera motion
+// Maps the heat values of the image to colors in the framebuffer; the float image (PFM) keeps the values themselves
+void mapHeatmap(const vector<float>& heatValues, Framebuffer* framebuffer, OutputImage* output, int res_x, int res_y)
+{
+	const char* names[] = { "", "BVH nodes", "grid cells", "primitive tests" };
+	float max_value = 0, sum = 0;
+	for (float v : heatValues) {
+		max_value = max(max_value, v);
+		sum += v;
+	}
+	float scale = heatmapMax > 0 ? heatmapMax : max_value;
+	printf("\nHEATMAP: %s per sample of the %s, mean %.2f, max %.2f, ramp 0 to %.2f\n", names[heatmapMode],
+		heatmapPrimary ? "primary rays" : "ray trees", sum / heatValues.size(), max_value, scale);
+
+	float* sums = framebuffer->Row(0);
+	framebuffer->samples = 1;
+	for (int i = 0; i < res_x * res_y; i++) {
+		Color color = heatRamp(scale > 0 ? heatValues[i] / scale : 0);
+		sums[3 * i] = color.r();
+		sums[3 * i + 1] = color.g();
+		sums[3 * i + 2] = color.b();
+	}
+
+	if (output) {
+		framebuffer->Quantize(0, res_y, output->rgb);
+		if (output->hdr)
+			for (int i = 0; i < res_x * res_y; i++)
+				output->hdr[3 * i] = output->hdr[3 * i + 1] = output->hdr[3 * i + 2] = heatValues[i];
+		for (int y = 0; y < res_y; y++)
+			output->RowDone(y);
 	}
-	set_rand_seed(42);
-	for (int y = 0; y < RES_Y; y++)
+}
+
+/////////////////////////////////////////////////////////////////////// RENDERING
+
+// Render function by primary ray casting from the eye towards the scene's objects
+// The samples of each pixel are summed into the framebuffer (their heat values into heat_values, in the heatmap modes);
+// each finished row is then quantized into output (NULL when only drawing) and passed to the image writer. Each thread
+// renders the rows it takes from next_row.
+
+void renderRows(Camera* camera, Framebuffer* framebuffer, vector<float>* heat_values, OutputImage* output, std::atomic<int>* next_row)
+{
+	int res_x = camera->GetResX(), res_y = camera->GetResY();
+	traceThreadName("render");
+	PerfScope perf(PERF_RENDER);
+	unsigned long long allocs_start = threadAllocations();   //the rows themselves must not allocate (ALLOC_COUNT builds)
+
+	for (int y = (*next_row)++; y < res_y; y = (*next_row)++)
 	{
-		for (int x = 0; x < RES_X; x++)
+		TraceSpan row_span("row", "render", y);
+		float* sums = framebuffer->Row(y);
+
+		set_rand_seed(row_seed(42, y));  //seeded per row, so that the image does not depend on the number of threads
+		for (int x = 0; x < res_x; x++)
 		{
 			Color color = Color(0,0,0); 
+			unsigned long long heat_start = heatmapCount();
 
 			Vector pixel;  //viewport coordinates
 			pixel.x = x + 0.5f;
@@ -642,55 +812,100 @@ void renderScene()
 						pixelSample.x = x + (p + epsilon) / sppSquared;
 						pixelSample.y = y + (q + epsilon) / sppSquared;
 						
-						if(scene->GetCamera()->GetAperture() > 0)
+						if(camera->GetAperture() > 0)
 						{
-							Ray ray = scene->GetCamera()->PrimaryRay(sample_unit_disk() * scene->GetCamera()->GetAperture()* dofMod, pixelSample);
+							Ray ray = camera->PrimaryRay(sample_unit_disk() * camera->GetAperture()* dofMod, pixelSample);
 							
-							color = color + rayTracing(ray, 1, 1.0);
+							color = color + samplePixel(ray);
 						}
 						else
 						{
-							Ray ray = scene->GetCamera()->PrimaryRay(pixelSample);
-							color = color + rayTracing(ray, 1, 1.0);
+							Ray ray = camera->PrimaryRay(pixelSample);
+							color = color + samplePixel(ray);
 						}
 
 					} 
-				color = color * (1.f / SPP);
 			} 
 
 			else {
-				Ray ray = scene->GetCamera()->PrimaryRay(pixel);
-				color = color + rayTracing(ray, 1, 1.0).clamp();
+				Ray ray = camera->PrimaryRay(pixel);
+				color = color + samplePixel(ray).clamp();
 
 			}
 
-			img_Data[counter++] = u8fromfloat((float)color.r());
-			img_Data[counter++] = u8fromfloat((float)color.g());
-			img_Data[counter++] = u8fromfloat((float)color.b());
+			if (heatmapMode != HEAT_OFF) {  //the colors are set by mapHeatmap once the whole image is done
+				(*heat_values)[y * res_x + x] = (float)(heatmapCount() - heat_start) / (withAntialiasing ? spp : 1);
+				continue;
+			}
 
-			if (drawModeEnabled) {
-				vertices[index_pos++] = (float)x;
-				vertices[index_pos++] = (float)y;
-				colors[index_col++] = (float)color.r();
+			sums[3 * x] += color.r();
+			sums[3 * x + 1] += color.g();
+			sums[3 * x + 2] += color.b();
+		}
+		if (output && heatmapMode == HEAT_OFF) {  //display quantization of the finished row
+			framebuffer->Quantize(y, y + 1, output->rgb + 3 * y * res_x);
+			if (output->hdr) framebuffer->Resolve(y, y + 1, output->hdr + 3 * y * res_x);
+			output->RowDone(y);
+		}
+	}
+	addRenderAllocations(threadAllocations() - allocs_start);
+	raysTraced += rayCounter;
+	rayCounter = 0;
+	mergeThreadStats();
+	if (rayCapture) rayCapture->FlushThread();
+}
 
-				colors[index_col++] = (float)color.g();
+void renderImage(Camera* camera, OutputImage* output, unsigned int n_threads)
+{
+	TraceSpan span("render image", "render");
+	std::atomic<int> next_row(0);
+	vector<std::thread> workers;
+
+	Framebuffer image_framebuffer;  //the images of the batch and animation modes are rendered concurrently
+	Framebuffer* framebuffer = output ? &image_framebuffer : &displayFramebuffer;
+	framebuffer->Resize(camera->GetResX(), camera->GetResY());
+	framebuffer->samples = withAntialiasing ? spp : 1;
+
+	vector<float> heat_values;  //per image too
+	if (heatmapMode != HEAT_OFF)
+		heat_values.assign(camera->GetResX() * camera->GetResY(), 0.0f);
+
+	for (unsigned int i = 1; i < n_threads; i++)
+		workers.push_back(std::thread(renderRows, camera, framebuffer, &heat_values, output, &next_row));
+	renderRows(camera, framebuffer, &heat_values, output, &next_row);
+	for (std::thread& worker : workers)
+		worker.join();
+
+	if (heatmapMode != HEAT_OFF)
+		mapHeatmap(heat_values, framebuffer, output, camera->GetResX(), camera->GetResY());
+}
 
-				colors[index_col++] = (float)color.b();
-			}
-		}
-	
+unsigned int renderThreads()
+{
+	return numThreads > 0 ? numThreads : max(std::thread::hardware_concurrency(), 1u);
+}
+
+void renderScene()
+{
+	dofMod += 1*dofDir;
+	if (dofMod == 6)
+		dofDir = -1;
+	if (dofMod <= 1)
+		dofDir = 1;
+
+	if (drawModeEnabled) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		scene->GetCamera()->SetEye(Vector(camX, camY, camZ));  //Camera motion
 	}
+
 	if(drawModeEnabled) {
+		renderImage(scene->GetCamera(), NULL, renderThreads());
 		drawPoints();
 		glutSwapBuffers();
 	}
 	else {
+		renderImage(scene->GetCamera(), imageWriter->BeginImage(outputFile, RES_X, RES_Y), renderThreads());
 		printf("Terminou o desenho!\n");
-		if (saveImgFile("RT_Output.png") != IL_NO_ERROR) {
-			printf("Error saving Image file\n");
-			exit(0);
-		}
-		printf("Image file created\n");
 	}
 }
 
@@ -912,15 +1127,172 @@ void init(int argc, char* argv[])
 }
 
 
+const char* accelNames[NUM_ACCELERATORS] = { "none", "grid", "bvh", "qbvh" };
+
+bool parseAccel(const string& name, Accelerator& accel)
+{
+	for (int a = 0; a < NUM_ACCELERATORS; a++)
+		if (name == accelNames[a]) {
+			accel = (Accelerator)a;
+			return true;
+		}
+	return false;
+}
+
+const char* accelName(Accelerator accel)
+{
+	return accelNames[accel];
+}
+
+string resolveSceneFile(const string& scene_file)
+{
+	if (scene_file.empty()) return "";
+	if (!ifstream(scene_file, ios::in).fail()) return scene_file;
+	string scene_name = "P3D_Scenes/" + scene_file;
+	return ifstream(scene_name, ios::in).fail() ? "" : scene_name;
+}
+
+Scene* load_scene(const char* scene_name)
+{
+	TraceSpan span("parse scene", "scene");
+	Scene* new_scene = new Scene();
+
+	if (outOfCore)
+		new_scene->SetOutOfCore(pageBudgetMB * 1024 * 1024, outOfCoreMinFaces);
+	new_scene->SetCompactMeshes(compactMinFaces);
+	if (!new_scene->load_p3f(scene_name)) {
+		delete new_scene;
+		return NULL;
+	}
+	return new_scene;
+}
+
+Scene* generate_scene(unsigned long long count)
+{
+	TraceSpan span("generate scene", "scene");
+	SceneGenParams params = genParams;
+	params.count = count;
+
+	Scene* new_scene = new Scene();
+	generateScene(new_scene, params);
+	printf("Synthetic scene: %llu primitives, %s, seed %u\n", count, genDistributionName(params.distribution), params.seed);
+	return new_scene;
+}
+
+void build_accelerator(Scene* a_scene, Grid** grid, BVH** bvh)
+{
+	TraceSpan span(Accel_Struct == BVH_ACC || Accel_Struct == QBVH_ACC ? "build BVH" : "build grid", "accelerator");
+	PerfScope perf(PERF_BUILD);
+	std::vector<Object*> objs;
+	int num_objects = a_scene->getNumObjects();
+
+	for (int o = 0; o < num_objects; o++) {
+		objs.push_back(a_scene->getObject(o));
+	}
+
+	//GRID ACCELERATOR
+	if (Accel_Struct == GRID_ACC) {
+		*grid = new Grid();
+		if (gridDensity > 0) (*grid)->setDensity(gridDensity);
+		(*grid)->Build(objs);
+		printf("Grid built.\n\n");
+	}
+	//BVH ACCELERATOR
+	else if (Accel_Struct == BVH_ACC || Accel_Struct == QBVH_ACC) {
+		*bvh = new BVH();
+		if (bvhThreshold > 0) (*bvh)->setThreshold(bvhThreshold);
+		(*bvh)->setQuantized(Accel_Struct == QBVH_ACC);
+		(*bvh)->Build(objs);
+		printf(Accel_Struct == QBVH_ACC ? "Quantized BVH built.\n\n" : "BVH built.\n\n");
+	}
+}
+
+// Accelerator and grid density chosen under the memory budget, with the estimates of its memory
+struct AccelChoice {
+	Accelerator accel;
+	float grid_m;
+	size_t estimate, build_peak;   //bytes once built and at the peak of the build
+};
+
+// The candidates are tried from the usually fastest to the smallest: the quantized BVH (faster than the float tree on
+// large meshes, for the same build peak), the BVH, the grid at halved densities, and no accelerator, which always fits
+AccelChoice select_accelerator(Scene* a_scene)
+{
+	std::vector<Object*> objs;
+	for (int o = 0; o < a_scene->getNumObjects(); o++)
+		objs.push_back(a_scene->getObject(o));
+
+	vector<AccelChoice> candidates;
+	for (int q = 1; q >= 0; q--) {
+		BVH bvh;
+		if (bvhThreshold > 0) bvh.setThreshold(bvhThreshold);
+		bvh.setQuantized(q == 1);
+		AccelChoice choice = { q == 1 ? QBVH_ACC : BVH_ACC, 0 };
+		choice.estimate = bvh.EstimateMemory(objs.size(), choice.build_peak);
+		candidates.push_back(choice);
+	}
+	for (float m = gridDensity > 0 ? gridDensity : 2.0f; m >= budgetMinGridDensity; m /= 2) {
+		Grid grid;
+		grid.setDensity(m);
+		AccelChoice choice = { GRID_ACC, m };
+		choice.estimate = grid.EstimateMemory(objs, choice.build_peak);
+		candidates.push_back(choice);
+	}
+	AccelChoice none = { NONE, 0, 0, 0 };
+	candidates.push_back(none);
+
+	size_t budget = memoryBudget;
+	int chosen = -1;
+	printf("\nMEMORY BUDGET: %.1f MB for the accelerator of %zu objects\n", budget / (1024.0 * 1024.0), objs.size());
+	for (size_t c = 0; c < candidates.size(); c++) {
+		AccelChoice& candidate = candidates[c];
+		bool fits = candidate.build_peak <= budget;
+		if (fits && chosen < 0) chosen = (int)c;
+
+		char label[32];
+		if (candidate.accel == GRID_ACC) snprintf(label, sizeof(label), "grid m=%.2f", candidate.grid_m);
+		else snprintf(label, sizeof(label), "%s", accelName(candidate.accel));
+		if (candidate.estimate == SIZE_MAX)
+			printf("  %-12s too many cells\n", label);
+		else
+			printf("  %-12s %10.1f KB, build peak %10.1f KB  %s\n", label, candidate.estimate / 1024.0,
+				candidate.build_peak / 1024.0, chosen == (int)c ? "chosen" : fits ? "fits" : "over budget");
+	}
+
+	Accel_Struct = candidates[chosen].accel;
+	return candidates[chosen];
+}
+
+// Builds the accelerator of the scene: Accel_Struct, or with a memory budget the one chosen by select_accelerator,
+// reported with its estimated and actual memory
+void build_scene_accelerator(Scene* a_scene, Grid** grid, BVH** bvh)
+{
+	if (memoryBudget == 0) {
+		build_accelerator(a_scene, grid, bvh);
+		return;
+	}
+
+	AccelChoice choice = select_accelerator(a_scene);
+	float user_density = gridDensity;
+	if (choice.accel == GRID_ACC) gridDensity = choice.grid_m;
+	build_accelerator(a_scene, grid, bvh);
+	gridDensity = user_density;
+
+	size_t actual = *grid ? (*grid)->GetMemory() : *bvh ? (*bvh)->GetMemory() : 0;
+	printf("Accelerator memory: estimated %.1f KB, actual %.1f KB\n", choice.estimate / 1024.0, actual / 1024.0);
+}
+
 void init_scene(void)
 {
 	char scenes_dir[70] = "P3D_Scenes/";
 	char input_user[50] = "balls_low.p3f";
 	char scene_name[70];
 
-	scene = new Scene();
-
-	if (P3F_scene) {  //Loading a P3F scene
+	if (genParams.count > 0) {
+		scene = generate_scene(genParams.count);
+		snprintf(scene_name, sizeof(scene_name), "gen:%llu", genParams.count);   //all the parameters are in the capture name
+	}
+	else if (P3F_scene) {  //Loading a P3F scene
 
 		while (true) {
 			cout << "Input the Scene Name: ";
@@ -937,44 +1309,415 @@ void init_scene(void)
 				break;
 		}
 
-		scene->load_p3f(scene_name);
+		scene = load_scene(scene_name);
+		if (scene == NULL)
+			exit(EXIT_FAILURE);
 	}
 	else {
 		printf("Creating a Random Scene.\n\n");
+		scene = new Scene();
 		scene->create_random_scene();
 	}
 	RES_X = scene->GetCamera()->GetResX();
 	RES_Y = scene->GetCamera()->GetResY();
 	printf("\nResolutionX = %d  ResolutionY= %d.\n", RES_X, RES_Y);
 
-	//GRID ACCELERATOR
-	if (Accel_Struct == GRID_ACC) {
-		grid_ptr = new Grid();
-		std::vector<Object*> objs;
-		int num_objects = scene->getNumObjects();
+	build_scene_accelerator(scene, &grid_ptr, &bvh_ptr);
 
-		for (int o = 0; o < num_objects; o++) {
-			objs.push_back(scene->getObject(o));
-		}
-		grid_ptr->Build(objs);
-		printf("Grid built.\n\n");
+	if (captureFile != NULL) {
+		rayCapture = new RayCapture();
+		string capture_scene = genParams.count > 0 ? genSceneName(genParams) : P3F_scene ? scene_name : "";
+		if (!rayCapture->Open(captureFile, capture_scene))
+			exit(EXIT_FAILURE);
 	}
-	//BVH ACCELERATOR
-	else if (Accel_Struct == BVH_ACC) {
-		bvh_ptr = new BVH();
-		std::vector<Object*> objs;
-		int num_objects = scene->getNumObjects();
+}
+
+/////////////////////////////////////////////////////////////////////// BATCH MODE
 
-		for (int o = 0; o < num_objects; o++) {
-			objs.push_back(scene->getObject(o));
+double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Renders a queue of jobs without user interaction. Returns the number of failed jobs.
+int runBatch(istream& jobs)
+{
+	SceneCache cache(sceneCacheSize);
+	RenderJob job;
+	int line_number = 0, n_jobs = 0, n_failed = 0;
+	auto batchStart = std::chrono::high_resolution_clock::now();
+	unsigned long long rays_start = raysTraced;
+	int default_spp = spp;   //of -spp, for the jobs without their own
+	resetPerfCounters();
+
+	while (readJob(jobs, job, line_number)) {
+		n_jobs++;
+		auto jobStart = std::chrono::high_resolution_clock::now();
+		printf("\nJOB %d (line %d): %s\n", n_jobs, job.line, job.scene.c_str());
+
+		//scene and accelerator, parsed and built only if they are not in the cache
+		string key = job.scene + "|" + (memoryBudget > 0 ? "budget" : accelName(Accel_Struct));
+		CachedScene* cached = cache.Find(key);
+		bool cache_hit = cached != NULL;
+		if (!cache_hit) {
+			string scene_name = resolveSceneFile(job.scene);
+			if (scene_name.empty()) {
+				printf("Error opening P3F file %s. Job skipped.\n", job.scene.c_str());
+				n_failed++;
+				continue;
+			}
+
+			cached = new CachedScene();
+			cached->key = key;
+			cached->grid = NULL;
+			cached->bvh = NULL;
+			auto parseStart = std::chrono::high_resolution_clock::now();
+			cached->scene = load_scene(scene_name.c_str());
+			cached->parse_time = elapsedMs(parseStart);
+			if (cached->scene == NULL) {
+				printf("Error loading P3F file %s. Job skipped.\n", job.scene.c_str());
+				delete cached;
+				n_failed++;
+				continue;
+			}
+			if (cached->scene->GetCamera() == NULL) {
+				printf("Scene %s has no camera. Job skipped.\n", job.scene.c_str());
+				delete cached->scene;
+				delete cached;
+				n_failed++;
+				continue;
+			}
+			auto buildStart = std::chrono::high_resolution_clock::now();
+			build_scene_accelerator(cached->scene, &cached->grid, &cached->bvh);
+			cached->accel = Accel_Struct;
+			cached->build_time = elapsedMs(buildStart);
+			cache.Insert(cached);
 		}
-		bvh_ptr->Build(objs);
-		printf("BVH built.\n\n");
+
+		scene = cached->scene;
+		grid_ptr = cached->grid;
+		bvh_ptr = cached->bvh;
+		Accel_Struct = (Accelerator)cached->accel;
+
+		//per job camera and samples per pixel
+		Camera* scene_camera = scene->GetCamera();
+		Camera* job_camera = makeJobCamera(scene_camera, job);
+		scene->SetCamera(job_camera);
+		setSPP(job.spp > 0 ? job.spp : default_spp);
+
+		RES_X = job_camera->GetResX();
+		RES_Y = job_camera->GetResY();
+
+		//the image of the previous job is still being written while this one renders; wait only if the output queue is full
+		auto queueStart = std::chrono::high_resolution_clock::now();
+		OutputImage* output = imageWriter->BeginImage(job.output, RES_X, RES_Y);
+		double queue_time = elapsedMs(queueStart);
+
+		resetRayStats();
+		resetRenderAllocations();
+		auto renderStart = std::chrono::high_resolution_clock::now();
+		renderImage(job_camera, output, renderThreads());
+		double render_time = elapsedMs(renderStart);
+
+		scene->SetCamera(scene_camera);
+		delete job_camera;
+
+		printf("JOB %d: %s %dx%d spp=%d -> %s\n", n_jobs, job.scene.c_str(), RES_X, RES_Y, spp, job.output.c_str());
+		if (cache_hit)
+			printf("JOB %d: parse cached, build cached, output wait %.2f ms, render %.2f ms, total %.2f ms\n", n_jobs, queue_time, render_time, elapsedMs(jobStart));
+		else
+			printf("JOB %d: parse %.2f ms, build %.2f ms, output wait %.2f ms, render %.2f ms, total %.2f ms\n",
+				n_jobs, cached->parse_time, cached->build_time, queue_time, render_time, elapsedMs(jobStart));
+		printRayStats();
+		printRenderAllocations();
+		scene->PrintPagingStats();
 	}
 
-	// Pixel buffer to be used in the Save Image function
-	img_Data = (uint8_t*)malloc(3*RES_X*RES_Y * sizeof(uint8_t));
-	if (img_Data == NULL) exit(1);
+	unsigned int write_errors = imageWriter->getErrors();
+	imageWriter->Flush();
+	n_failed += imageWriter->getErrors() - write_errors;
+
+	printf("\nBATCH: %d jobs, %d failed, %.2f (sec); scene cache: %u hits, %u misses, %u evictions\n",
+		n_jobs, n_failed, elapsedMs(batchStart) / 1000, cache.getHits(), cache.getMisses(), cache.getEvictions());
+	printTextureCacheStats();
+	printPerfCounters(raysTraced - rays_start);
+	printHugePageReport();
+	scene = NULL;
+	grid_ptr = NULL;
+	bvh_ptr = NULL;
+	return n_failed;
+}
+
+/////////////////////////////////////////////////////////////////////// ANIMATION MODE
+
+// Renders the frames of a camera path. The scene is parsed and the accelerator built once and shared by all the
+// frames; each thread renders whole frames, which are written in order by the image writer while the next ones render.
+// Returns the number of frames that were not saved.
+int runAnimation(const char* path_file)
+{
+	CameraPath path;
+	if (!path.Load(path_file))
+		return -1;
+
+	string scene_name = resolveSceneFile(path.getScene());
+	if (scene_name.empty()) {
+		printf("\nError opening P3F file %s.\n", path.getScene().c_str());
+		return -1;
+	}
+
+	auto animStart = std::chrono::high_resolution_clock::now();
+	unsigned long long rays_start = raysTraced;
+	resetPerfCounters();
+	scene = load_scene(scene_name.c_str());
+	if (scene == NULL) {
+		printf("Error loading P3F file %s.\n", path.getScene().c_str());
+		return -1;
+	}
+	if (scene->GetCamera() == NULL) {
+		printf("Scene %s has no camera.\n", path.getScene().c_str());
+		return -1;
+	}
+	double parse_time = elapsedMs(animStart);
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	build_scene_accelerator(scene, &grid_ptr, &bvh_ptr);
+	double build_time = elapsedMs(buildStart);
+
+	if (path.getSPP() > 0)
+		setSPP(path.getSPP());
+	RES_X = scene->GetCamera()->GetResX();
+	RES_Y = scene->GetCamera()->GetResY();
+
+	int n_frames = path.getNumFrames();
+	vector<Camera*> cameras;
+	for (int f = 0; f < n_frames; f++)
+		cameras.push_back(path.GetFrameCamera(f, scene->GetCamera()));
+
+	unsigned int n_threads = min(renderThreads(), (unsigned int)n_frames);
+	printf("\nANIMATION: %d frames of %dx%d, spp=%d, %u threads; parse %.2f ms, build %.2f ms\n",
+		n_frames, RES_X, RES_Y, spp, n_threads, parse_time, build_time);
+
+	int next_frame = 0;
+	std::mutex frame_lock;  //frames are claimed and queued in order, so that they are also written in order
+	unsigned int write_errors = imageWriter->getErrors();
+
+	auto renderFrames = [&]() {
+		while (true) {
+			int f;
+			OutputImage* output;
+			{
+				std::lock_guard<std::mutex> guard(frame_lock);
+				if (next_frame >= n_frames) return;
+				f = next_frame++;
+				output = imageWriter->BeginImage(path.getFrameFileName(f), RES_X, RES_Y);
+			}
+
+			auto frameStart = std::chrono::high_resolution_clock::now();
+			renderImage(cameras[f], output, 1);
+			printf("FRAME %d: render %.2f ms -> %s\n", f, elapsedMs(frameStart), path.getFrameFileName(f).c_str());
+		}
+	};
+
+	resetRayStats();
+	resetRenderAllocations();
+	auto renderStart = std::chrono::high_resolution_clock::now();
+	vector<std::thread> workers;
+	for (unsigned int i = 1; i < n_threads; i++)
+		workers.push_back(std::thread(renderFrames));
+	renderFrames();
+	for (std::thread& worker : workers)
+		worker.join();
+	imageWriter->Flush();
+	double render_time = elapsedMs(renderStart);
+	int n_failed = imageWriter->getErrors() - write_errors;
+
+	printf("\nANIMATION: %d frames in %.2f (sec), %.2f ms per frame, %d failed\n",
+		n_frames, render_time / 1000, render_time / n_frames, n_failed);
+	printPerfCounters(raysTraced - rays_start);
+	printHugePageReport();
+	printRayStats();
+	printRenderAllocations();
+	scene->PrintPagingStats();
+
+	for (Camera* camera : cameras)
+		delete camera;
+	return n_failed;
+}
+
+/////////////////////////////////////////////////////////////////////// COMMAND LINE
+
+void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  -batch <file>   render the jobs of a job list without user interaction (\"-\" reads the jobs from stdin)\n");
+	printf("  -cache <n>      number of parsed scenes kept between batch jobs (default %u)\n", sceneCacheSize);
+	printf("  -accel <type>   accelerator: none, grid, bvh or qbvh (BVH with 8-bit quantized child boxes)\n");
+	printf("  -spp <n>        samples per pixel, a square number (others are rounded to the nearest)\n");
+	printf("  -o <file>       image file of the headless mode (default RT_Output.png); .ppm and .pfm (linear float) files are written by the renderer, other formats by DevIL\n");
+	printf("  -stream <target> send the images as PPM frames to stdout (\"-\") or a named pipe instead of files, e.g. for ffmpeg -f image2pipe -i -\n");
+	printf("  -rgb            stream raw RGB frames without header (ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i -)\n");
+	printf("  -bench          benchmark the scenes of P3D_Scenes under each accelerator, SPP and thread count\n");
+	printf("  -bench-scenes <a.p3f,b.p3f>  -bench-accel <none,grid,bvh>  -bench-spp <1,4>  -bench-threads <1,8>\n");
+	printf("                  comma separated lists of the benchmark runs\n");
+	printf("  -bench-out <file>  benchmark results, JSON or CSV by the extension (default bench.json)\n");
+	printf("  -bench-label <text>  label of the results, e.g. the commit\n");
+	printf("  -heatmap <nodes|cells|tests>  render BVH nodes visited, grid cells stepped or primitive tests per pixel instead of colors (needs RAY_STATS)\n");
+	printf("  -heatmap-primary  heatmap of the primary rays only, instead of the whole ray trees\n");
+	printf("  -heatmap-max <v>  value at the top of the heatmap ramp (default: the maximum of the image)\n");
+	printf("  -regress        render the scenes of -bench-scenes with the accelerators of -bench-accel and compare them with their golden images\n");
+	printf("  -regress-update render the golden images instead\n");
+	printf("  -golden-dir <dir>  directory of the golden images (default %s)\n", goldenDir);
+	printf("  -accel-report   build the accelerators of -bench-accel for the scenes of -bench-scenes and print their quality reports\n");
+	printf("  -bvh-leaf <n>   maximum objects per BVH leaf (default 25)\n");
+	printf("  -grid-m <f>     cell density factor of the grid (default 2.0)\n");
+	printf("  -mem-budget <MB>  build the fastest accelerator whose estimated memory fits in MB, instead of -accel (headless, batch and animation)\n");
+	printf("  -trace <file>   write a timeline of the run (scene parse, accelerator build, rows rendered per thread, image writes, GL upload) as Chrome trace JSON\n");
+	printf("  -perf           count cycles, instructions, cache, TLB and branch misses of the build, render and encode phases (Linux perf_event)\n");
+	printf("  -huge-pages     allocate the large BVH, grid and primitive buffers on huge pages where the system allows it, and report them\n");
+	printf("  -capture <file> record the rays traced for the image of the headless mode\n");
+	printf("  -replay <file>  trace the rays of a capture through the accelerators of -bench-accel with the thread counts of -bench-threads\n");
+	printf("  -gen <count>    render a synthetic scene of count primitives (e.g. 1e6) instead of a P3F file\n");
+	printf("  -gen-dist <uniform|clustered|stadium>  -gen-mix <spheres,triangles,boxes>  -gen-seed <n>\n");
+	printf("                  distribution, relative weights of the primitive types (default 1,0,0) and seed of the synthetic scenes\n");
+	printf("  -gen-out <file> write the synthetic scene of -gen as a P3F file and exit\n");
+	printf("                  the benchmark scenes \"gen:<count>\" of -bench-scenes are synthetic scenes too\n");
+	printf("  -anim <file>    render the frames of a camera path without user interaction\n");
+	printf("  -threads <n>    rendering threads, sharing the rows of each image or rendering whole animation frames (default: one per core)\n");
+}
+
+void parseArguments(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+
+		if (!strcmp(argv[i], "-batch") && has_value) {
+			batchFile = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-anim") && has_value) {
+			cameraPathFile = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-threads") && has_value)
+			numThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-bench")) {
+			benchmark = true;
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-bench-scenes") && has_value)
+			benchScenes = argv[++i];
+		else if (!strcmp(argv[i], "-bench-accel") && has_value)
+			benchAccels = argv[++i];
+		else if (!strcmp(argv[i], "-bench-spp") && has_value)
+			benchSPP = argv[++i];
+		else if (!strcmp(argv[i], "-bench-threads") && has_value)
+			benchThreads = argv[++i];
+		else if (!strcmp(argv[i], "-bench-out") && has_value)
+			benchOutput = argv[++i];
+		else if (!strcmp(argv[i], "-bench-label") && has_value)
+			benchLabel = argv[++i];
+		else if (!strcmp(argv[i], "-regress") || !strcmp(argv[i], "-regress-update")) {
+			goldenRegression = true;
+			goldenUpdate = !strcmp(argv[i], "-regress-update");
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-golden-dir") && has_value)
+			goldenDir = argv[++i];
+		else if (!strcmp(argv[i], "-accel-report")) {
+			accelReport = true;
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-bvh-leaf") && has_value)
+			bvhThreshold = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-grid-m") && has_value)
+			gridDensity = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-mem-budget") && has_value) {
+			i++;
+			double budget_mb = atof(argv[i]);   //fractions of a MB are kept
+			if (!(budget_mb > 0)) {
+				printf("Invalid memory budget '%s': a positive number of MB\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+			double budget_bytes = budget_mb * 1024 * 1024;
+			memoryBudget = budget_bytes < (double)SIZE_MAX ? max((size_t)budget_bytes, (size_t)1) : SIZE_MAX;
+		}
+		else if (!strcmp(argv[i], "-trace") && has_value)
+			traceFile = argv[++i];
+		else if (!strcmp(argv[i], "-perf"))
+			perfCounting = true;
+		else if (!strcmp(argv[i], "-huge-pages"))
+			hugePagesEnabled = true;
+		else if (!strcmp(argv[i], "-gen") && has_value)
+			genParams.count = (unsigned long long)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-gen-dist") && has_value) {
+			i++;
+			if (!parseGenDistribution(argv[i], genParams.distribution)) {
+				printf("Unknown distribution '%s'\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (!strcmp(argv[i], "-gen-mix") && has_value) {
+			i++;
+			if (!parseGenMix(argv[i], genParams.mix)) {
+				printf("Wrong primitive mix '%s': expected weights of spheres, triangles and boxes, e.g. 1,1,0\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (!strcmp(argv[i], "-gen-seed") && has_value)
+			genParams.seed = (unsigned int)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-gen-out") && has_value) {
+			genOutput = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-capture") && has_value) {
+			captureFile = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-replay") && has_value) {
+			replayFile = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-heatmap") && has_value) {
+			i++;
+			if (!strcmp(argv[i], "nodes")) heatmapMode = HEAT_NODES;
+			else if (!strcmp(argv[i], "cells")) heatmapMode = HEAT_CELLS;
+			else if (!strcmp(argv[i], "tests")) heatmapMode = HEAT_TESTS;
+			else {
+				printf("Unknown heatmap '%s'\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+#ifndef RAY_STATS
+			printf("The heatmap needs the ray statistics: build with RAY_STATS defined\n");
+			exit(EXIT_FAILURE);
+#endif
+		}
+		else if (!strcmp(argv[i], "-heatmap-primary"))
+			heatmapPrimary = true;
+		else if (!strcmp(argv[i], "-heatmap-max") && has_value)
+			heatmapMax = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && has_value)
+			outputFile = argv[++i];
+		else if (!strcmp(argv[i], "-stream") && has_value) {
+			streamTarget = argv[++i];
+			drawModeEnabled = false;
+		}
+		else if (!strcmp(argv[i], "-rgb"))
+			streamRawRGB = true;
+		else if (!strcmp(argv[i], "-cache") && has_value)
+			sceneCacheSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-spp") && has_value) {
+			setSPP(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "-accel") && has_value) {
+			if (!parseAccel(argv[++i], Accel_Struct)) {
+				printf("Unknown accelerator '%s'\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-help")) {
+			printUsage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+	}
 }
 
 int main(int argc, char* argv[])
@@ -987,20 +1730,103 @@ int main(int argc, char* argv[])
 	}
 	ilInit();
 
-	int ch;
+	parseArguments(argc, argv);
+	if (traceFile != NULL && !traceOpen(traceFile))
+		exit(EXIT_FAILURE);
+	if (perfCounting) perfOpen();
 	if (!drawModeEnabled) {
+		imageWriter = new ImageWriter(outputQueueMB * 1024 * 1024);
+		if (streamTarget != NULL && !imageWriter->OpenStream(streamTarget, streamRawRGB))
+			exit(EXIT_FAILURE);
+	}
+
+	int ch;
+	if (genOutput != NULL) {
+		if (genParams.count == 0) {
+			printf("-gen-out needs the number of primitives of -gen\n");
+			exit(EXIT_FAILURE);
+		}
+		auto genStart = std::chrono::high_resolution_clock::now();
+		bool ok = writeGeneratedScene(genOutput, genParams);
+		if (ok) printf("Synthetic scene of %llu primitives written to %s in %.2f (sec)\n", genParams.count, genOutput, elapsedMs(genStart) / 1000);
+		delete imageWriter;
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	else if (benchmark) {
+		bool ok = runBenchmark();
+		delete imageWriter;
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	else if (goldenRegression) {
+		int n_failed = runGoldenRegression();
+		delete imageWriter;
+		exit(n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	else if (accelReport) {
+		bool ok = runAccelReport();
+		delete imageWriter;
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	else if (replayFile != NULL) {
+		bool ok = runReplay(replayFile);
+		delete imageWriter;
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	else if (cameraPathFile != NULL) {
+		int n_failed = runAnimation(cameraPathFile);
+		delete imageWriter;
+		exit(n_failed != 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	else if (batchFile != NULL) {
+		int n_failed;
+		if (!strcmp(batchFile, "-"))
+			n_failed = runBatch(cin);
+		else {
+			ifstream jobs(batchFile, ios::in);
+			if (jobs.fail()) {
+				printf("Error opening the job list %s\n", batchFile);
+				exit(EXIT_FAILURE);
+			}
+			n_failed = runBatch(jobs);
+		}
+		delete imageWriter;
+		exit(n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	else if (!drawModeEnabled) {
 
 		do {
+			unsigned long long rays_start = raysTraced;
+			resetPerfCounters();
 			init_scene();
+			resetRayStats();
+			resetRenderAllocations();
 			auto timeStart = std::chrono::high_resolution_clock::now();
 			renderScene();  //Just creating an image file
 			auto timeEnd = std::chrono::high_resolution_clock::now();
 			auto passedTime = std::chrono::duration<double, std::milli>(timeEnd - timeStart).count();
 			printf("\nDone: %.2f (sec)\n", passedTime / 1000);
-			if (!P3F_scene) break;
+			if (rayCapture) {
+				if (rayCapture->Close())
+					printf("%llu rays captured to %s\n", rayCapture->getCount(), captureFile);
+				delete rayCapture;
+				rayCapture = NULL;
+			}
+			printRayStats();
+			printRenderAllocations();
+			scene->PrintPagingStats();
+			unsigned int write_errors = imageWriter->getErrors();
+			imageWriter->Flush();
+			if (imageWriter->getErrors() == write_errors)
+				printf("Image file created\n");
+			printPerfCounters(raysTraced - rays_start);
+			printHugePageReport();
+			if (!P3F_scene || genParams.count > 0) break;
 			cout << "\nPress 'y' to render another image or another key to terminate!\n";
 			delete(scene);
-			free(img_Data);
+			delete grid_ptr;
+			delete bvh_ptr;
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
 			ch = _getch();
 		} while((toupper(ch) == 'Y')) ;
 	}
@@ -1014,12 +1840,17 @@ int main(int argc, char* argv[])
 		if (vertices == NULL) exit(1);
 		colors = (float*)malloc(size_colors);
 		if (colors == NULL) exit(1);
+		for (int i = 0; i < RES_X * RES_Y; i++) {
+			vertices[2 * i] = (float)(i % RES_X);
+			vertices[2 * i + 1] = (float)(i / RES_X);
+		}
 	   
 		/* Setup GLUT and GLEW */
 		init(argc, argv);
 		glutMainLoop();
 	}
 
+	delete imageWriter;
 	free(colors);
 	free(vertices);
 	printf("Program ended normally\n");
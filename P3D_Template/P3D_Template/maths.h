@@ -51,12 +51,25 @@ clamp(const double x, const double min, const double max) {
 }
 
 
+// ---------------------------------------------------- rand_state
+// the linear congruential generator of the MSVC rand(), with a state per thread so that images rendered
+// by concurrent threads are reproducible
+
+#define RAND_MAX_P3D 0x7fff
+
+inline unsigned int&
+rand_state(void) {
+	static thread_local unsigned int state = 1;
+	return state;
+}
+
+
 // ---------------------------------------------------- rand_int
-// a wrapper for rand()
 
 inline int
 rand_int(void) {
-	return(rand());
+	rand_state() = rand_state() * 214013u + 2531011u;
+	return((rand_state() >> 16) & RAND_MAX_P3D);
 }
 
 
@@ -64,7 +77,7 @@ rand_int(void) {
 
 inline float
 rand_float(void) {
-	return((float)rand() / ((float)RAND_MAX+1.0));
+	return((float)rand_int() / ((float)RAND_MAX_P3D+1.0));
 }
 
 
@@ -72,7 +85,7 @@ rand_float(void) {
 
 inline double
 rand_double(void) {
-	return((double)rand() / ((double)RAND_MAX + 1.0));
+	return((double)rand_int() / ((double)RAND_MAX_P3D + 1.0));
 }
 
 // ---------------------------------------------------- rand_double(min, max)
@@ -87,7 +100,19 @@ rand_double(double min, double max) {
 
 inline void
 set_rand_seed(const int seed) {
-	srand(seed);
+	rand_state() = (unsigned int)seed;
+}
+
+// ---------------------------------------------------- row_seed
+// seed for the n-th independent sequence (an image row): nearby seeds would give correlated sequences
+
+inline int
+row_seed(const int seed, const int n) {
+	unsigned int h = (unsigned int)seed ^ ((unsigned int)n * 0x9E3779B9u);
+	h ^= h >> 16; h *= 0x85EBCA6Bu;
+	h ^= h >> 13; h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return (int)h;
 }
 
 // ---------------------------------------------------- float to byte (unsigned char)
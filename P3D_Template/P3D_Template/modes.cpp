@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+#include "renderer.h"
+#include "modes.h"
+#include "bench.h"
+#include "sysinfo.h"
+#include "imageCompare.h"
+#include "perfCounters.h"
+#include "hugePages.h"
+#include "allocCounter.h"
+#include "rayCapture.h"
+
+const char* benchScenes = NULL;
+const char* benchAccels = "none,grid,bvh";
+const char* benchSPP = "1";
+const char* benchThreads = "1";
+const char* benchOutput = "bench.json";
+const char* benchLabel = "";
+int benchMaxObjectsNoAccel = 5000;
+
+bool goldenUpdate = false;
+const char* goldenDir = "P3D_Scenes/golden";
+const char* goldenExtension = ".png";
+int goldenSPP = 4;
+double goldenPSNR = 40.0;
+double goldenSSIM = 0.98;
+int goldenTolerance = 8;
+double goldenMaxBadPixels = 0.001;
+
+/////////////////////////////////////////////////////////////////////// BENCHMARK MODE
+
+// Renders every scene under every combination of the benchmark lists and writes the results. Returns false if a
+// scene could not be loaded or the results could not be written.
+bool runBenchmark()
+{
+	vector<string> scenes = benchScenes ? splitList(benchScenes) : listFiles("P3D_Scenes", ".p3f");
+	vector<string> accels = splitList(benchAccels);
+	vector<string> spps = splitList(benchSPP);
+	vector<string> threads = splitList(benchThreads);
+	vector<BenchResult> results;
+	bool ok = true;
+
+	if (scenes.empty()) {
+		printf("No scenes to benchmark\n");
+		return false;
+	}
+
+	for (string& scene_file : scenes) {
+		bool generated = !scene_file.compare(0, 4, "gen:");
+		string scene_name = generated ? scene_file : resolveSceneFile(scene_file);
+		if (scene_name.empty()) {
+			printf("Error opening P3F file %s. Scene skipped.\n", scene_file.c_str());
+			ok = false;
+			continue;
+		}
+
+		resetPeakRSS();
+		auto parseStart = std::chrono::high_resolution_clock::now();
+		if (generated)
+			scene = generate_scene((unsigned long long)atof(scene_file.c_str() + 4));   //parse time: generation time
+		else
+			scene = load_scene(scene_name.c_str());
+		double parse_time = elapsedMs(parseStart);
+		if (scene == NULL) {
+			printf("Error loading P3F file %s. Scene skipped.\n", scene_file.c_str());
+			ok = false;
+			continue;
+		}
+		if (scene->GetCamera() == NULL) {
+			printf("Scene %s has no camera. Scene skipped.\n", scene_file.c_str());
+			delete scene;
+			ok = false;
+			continue;
+		}
+		RES_X = scene->GetCamera()->GetResX();
+		RES_Y = scene->GetCamera()->GetResY();
+
+		for (string& accel : accels) {
+			if (!parseAccel(accel, Accel_Struct)) {
+				printf("Unknown accelerator '%s'\n", accel.c_str());
+				continue;
+			}
+
+			BenchResult result;
+			result.scene = scene_file;
+			result.accel = accel;
+			result.objects = scene->getNumObjects();
+			result.parse_ms = parse_time;
+			result.skipped = Accel_Struct == NONE && result.objects > benchMaxObjectsNoAccel;
+
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+			if (!result.skipped) {
+				resetPerfCounters();
+				auto buildStart = std::chrono::high_resolution_clock::now();
+				build_accelerator(scene, &grid_ptr, &bvh_ptr);
+				result.build_ms = elapsedMs(buildStart);
+			}
+
+			for (string& spp_item : spps)
+				for (string& threads_item : threads) {
+					setSPP(atoi(spp_item.c_str()));
+					result.spp = spp;
+					result.threads = max(atoi(threads_item.c_str()), 1);
+
+					if (!result.skipped) {
+						printf("\nBENCH %s %s spp=%d threads=%u\n", scene_file.c_str(), accel.c_str(), spp, result.threads);
+						raysTraced = 0;
+						auto renderStart = std::chrono::high_resolution_clock::now();
+						renderImage(scene->GetCamera(), NULL, result.threads);
+						result.render_ms = elapsedMs(renderStart);
+						result.rays = raysTraced;
+						result.mrays_per_s = result.rays / (result.render_ms * 1000);
+						result.peak_rss_mb = getPeakRSS() / (1024.0 * 1024.0);
+						printPerfCounters(result.rays);   //the build is counted with the first render
+						printHugePageReport();
+						resetPerfCounters();
+					}
+					results.push_back(result);
+				}
+
+			delete grid_ptr;
+			delete bvh_ptr;
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+		}
+		delete scene;
+		scene = NULL;
+	}
+
+	printBenchResults(results);
+	ok = writeBenchResults(benchOutput, benchLabel, results) && ok;
+	if (ok) printf("\nBenchmark results written to %s\n", benchOutput);
+	return ok;
+}
+
+/////////////////////////////////////////////////////////////////////// GOLDEN IMAGE REGRESSION
+
+// Prints the comparison of an image with another and returns whether it is within the thresholds
+bool checkImage(const char* accel, const char* against, OutputImage* image, const uint8_t* expected)
+{
+	ImageDiff diff = compareImages(image->rgb, expected, image->res_x, image->res_y, goldenTolerance);
+	bool pass = diff.psnr >= goldenPSNR && diff.ssim >= goldenSSIM && diff.bad_pixels <= goldenMaxBadPixels;
+	printf("  %-5s vs %-9s PSNR %6.2f dB  SSIM %.4f  max diff %3d  %6.3f%% pixels > %d  %s\n", accel, against,
+		min(diff.psnr, 99.99), diff.ssim, diff.max_diff, 100 * diff.bad_pixels, goldenTolerance, pass ? "PASS" : "FAIL");
+	return pass;
+}
+
+// Renders every scene with every accelerator and compares the images with the references and with each other, or
+// renders the references with goldenUpdate. Returns the number of failed checks.
+int runGoldenRegression()
+{
+	vector<string> scenes = benchScenes ? splitList(benchScenes) : listFiles("P3D_Scenes", ".p3f");
+	int n_failed = 0, n_checks = 0;
+
+	setSPP(goldenSPP);
+	if (goldenUpdate && !makeDirectory(goldenDir)) {
+		printf("Error creating the reference directory %s\n", goldenDir);
+		return 1;
+	}
+
+	for (string& scene_file : scenes) {
+		string scene_name = resolveSceneFile(scene_file);
+		if (scene_name.empty()) {
+			printf("Error opening P3F file %s.\n", scene_file.c_str());
+			n_checks++;   //a scene that cannot be checked fails its check
+			n_failed++;
+			continue;
+		}
+
+		string base_name = scene_file.substr(scene_file.find_last_of("/\\") + 1);
+		base_name = base_name.substr(0, base_name.find_last_of('.'));
+		string reference_file = string(goldenDir) + "/" + base_name + "_spp" + to_string(spp) + goldenExtension;
+
+		scene = load_scene(scene_name.c_str());
+		if (scene == NULL) {
+			printf("Error loading P3F file %s.\n", scene_file.c_str());
+			n_checks++;
+			n_failed++;
+			continue;
+		}
+		RES_X = scene->GetCamera()->GetResX();
+		RES_Y = scene->GetCamera()->GetResY();
+
+		vector<uint8_t> reference;
+		int ref_x = 0, ref_y = 0;
+		if (!goldenUpdate && (!loadImageRGB(reference_file, reference, ref_x, ref_y) || ref_x != RES_X || ref_y != RES_Y)) {
+			printf("\nREGRESSION %s: no reference image %s of %dx%d (render it with -regress-update)\n", scene_file.c_str(),
+				reference_file.c_str(), RES_X, RES_Y);
+			n_checks++;
+			n_failed++;
+			delete scene;
+			continue;
+		}
+		printf("\nREGRESSION %s, spp=%d, reference %s\n", scene_file.c_str(), spp, reference_file.c_str());
+
+		OutputImage* first = NULL;
+		const char* first_accel = NULL;
+		for (string& accel : splitList(benchAccels)) {
+			if (!parseAccel(accel, Accel_Struct)) {
+				printf("Unknown accelerator '%s'\n", accel.c_str());
+				continue;
+			}
+			if (Accel_Struct == NONE && scene->getNumObjects() > benchMaxObjectsNoAccel) continue;
+
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+			build_accelerator(scene, &grid_ptr, &bvh_ptr);
+
+			if (goldenUpdate) {  //the references are rendered with the first accelerator
+				renderImage(scene->GetCamera(), imageWriter->BeginImage(reference_file, RES_X, RES_Y), renderThreads());
+				printf("  %s -> %s\n", accel.c_str(), reference_file.c_str());
+			}
+			else {
+				OutputImage* image = new OutputImage(reference_file, RES_X, RES_Y);
+				resetRenderAllocations();
+				renderImage(scene->GetCamera(), image, renderThreads());
+
+#ifdef ALLOC_COUNT  //the render loop must not allocate
+				n_checks++;
+				printf("  %-5s heap allocations while rendering: %llu  %s\n", accelName(Accel_Struct), getRenderAllocations(),
+					getRenderAllocations() == 0 ? "PASS" : "FAIL");
+				if (getRenderAllocations() > 0) n_failed++;
+#endif
+				n_checks++;
+				if (!checkImage(accelName(Accel_Struct), "reference", image, reference.data())) n_failed++;
+				if (first == NULL) {
+					first = image;
+					first_accel = accelName(Accel_Struct);
+				}
+				else {
+					n_checks++;
+					if (!checkImage(accelName(Accel_Struct), first_accel, image, first->rgb)) n_failed++;
+					delete image;
+				}
+			}
+
+			delete grid_ptr;
+			delete bvh_ptr;
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+			if (goldenUpdate) break;
+		}
+		delete first;
+		delete scene;
+		scene = NULL;
+	}
+
+	if (goldenUpdate) {
+		unsigned int write_errors = imageWriter->getErrors();
+		imageWriter->Flush();
+		n_failed += imageWriter->getErrors() - write_errors;
+		printf("\nREGRESSION: references written, %d failed\n", n_failed);
+	}
+	else
+		printf("\nREGRESSION: %d of %d checks failed\n", n_failed, n_checks);
+	return n_failed;
+}
+
+/////////////////////////////////////////////////////////////////////// ACCELERATOR REPORT
+
+// Builds the accelerators of benchAccels for every scene of benchScenes and prints their quality reports. Returns false
+// if a scene could not be loaded.
+bool runAccelReport()
+{
+	vector<string> scenes = benchScenes ? splitList(benchScenes) : listFiles("P3D_Scenes", ".p3f");
+	bool ok = !scenes.empty();
+
+	for (string& scene_file : scenes) {
+		string scene_name = resolveSceneFile(scene_file);
+		if (scene_name.empty()) {
+			printf("Error opening P3F file %s. Scene skipped.\n", scene_file.c_str());
+			ok = false;
+			continue;
+		}
+		scene = load_scene(scene_name.c_str());
+		if (scene == NULL) {
+			printf("Error loading P3F file %s. Scene skipped.\n", scene_file.c_str());
+			ok = false;
+			continue;
+		}
+		printf("\nSCENE %s: %d objects\n", scene_file.c_str(), scene->getNumObjects());
+
+		for (string& accel : splitList(benchAccels)) {
+			if (!parseAccel(accel, Accel_Struct)) {
+				printf("Unknown accelerator '%s'\n", accel.c_str());
+				continue;
+			}
+			if (Accel_Struct == NONE) continue;
+
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+			auto buildStart = std::chrono::high_resolution_clock::now();
+			build_accelerator(scene, &grid_ptr, &bvh_ptr);
+			double build_time = elapsedMs(buildStart);
+
+			if (grid_ptr) grid_ptr->PrintReport();
+			if (bvh_ptr) bvh_ptr->PrintReport();
+			printHugePageReport();
+			printf("Build time: %.2f ms\n", build_time);
+
+			delete grid_ptr;
+			delete bvh_ptr;
+			grid_ptr = NULL;
+			bvh_ptr = NULL;
+		}
+		delete scene;
+		scene = NULL;
+	}
+	return ok;
+}
+
+/////////////////////////////////////////////////////////////////////// RAY REPLAY
+
+// Traces the captured rays, shared by the threads in blocks, through the current accelerator and counts the hits
+// (the occluded shadow rays)
+void replayRays(vector<CapturedRay>* rays, std::atomic<size_t>* next_block, std::atomic<unsigned long long>* hits)
+{
+	const size_t block_size = 1024;
+	unsigned long long n_hits = 0;
+
+	for (size_t start = (*next_block)++ * block_size; start < rays->size(); start = (*next_block)++ * block_size) {
+		size_t end = min(start + block_size, rays->size());
+		for (size_t i = start; i < end; i++) {
+			CapturedRay& r = (*rays)[i];
+			Vector origin(r.origin[0], r.origin[1], r.origin[2]);
+			Vector direction(r.direction[0], r.direction[1], r.direction[2]);
+			if (r.type == RAY_SHADOW) {
+				Vector light = origin + direction * r.tmax;
+				if (isPointObstructed(origin, light)) n_hits++;
+			}
+			else {
+				Ray ray(origin, direction);
+				Vector hitPoint;
+				if (closestHit(ray, hitPoint) != NULL) n_hits++;
+			}
+		}
+	}
+	*hits += n_hits;
+}
+
+// Replays a ray capture through every accelerator of benchAccels with every thread count of benchThreads and prints
+// the traversal throughput of each type of ray. Returns false if the capture or its scene could not be loaded.
+bool runReplay(const char* file_name)
+{
+	const char* type_names[] = { "primary", "shadow", "secondary" };
+	string scene_file;
+	vector<CapturedRay> captured;
+
+	if (!loadCapturedRays(file_name, scene_file, captured))
+		return false;
+
+	//the rays of each type are replayed apart, in the order they were captured
+	vector<CapturedRay> rays[NUM_RAY_TYPES];
+	for (CapturedRay& r : captured)
+		if (r.type < NUM_RAY_TYPES) rays[r.type].push_back(r);
+	vector<CapturedRay>().swap(captured);
+
+	if (!scene_file.compare(0, 4, "gen:")) {  //a generated scene, generated again from the parameters of its name
+		if (!parseGenSceneName(scene_file, genParams)) {
+			printf("Invalid generated scene '%s' in the capture.\n", scene_file.c_str());
+			return false;
+		}
+		scene = generate_scene(genParams.count);
+	}
+	else {
+		string scene_name = resolveSceneFile(scene_file);
+		if (scene_name.empty()) {
+			printf("Error opening the P3F file '%s' of the capture.\n", scene_file.c_str());
+			return false;
+		}
+		scene = load_scene(scene_name.c_str());
+		if (scene == NULL)
+			return false;
+	}
+
+	printf("\nREPLAY %s: %zu primary, %zu shadow and %zu secondary rays of %s\n", file_name,
+		rays[RAY_PRIMARY].size(), rays[RAY_SHADOW].size(), rays[RAY_SECONDARY].size(), scene_file.c_str());
+
+	for (string& accel : splitList(benchAccels)) {
+		if (!parseAccel(accel, Accel_Struct)) {
+			printf("Unknown accelerator '%s'\n", accel.c_str());
+			continue;
+		}
+		if (Accel_Struct == NONE && scene->getNumObjects() > benchMaxObjectsNoAccel) {
+			printf("\n%s skipped: %d objects\n", accel.c_str(), scene->getNumObjects());
+			continue;
+		}
+
+		grid_ptr = NULL;
+		bvh_ptr = NULL;
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		build_accelerator(scene, &grid_ptr, &bvh_ptr);
+		double build_time = elapsedMs(buildStart);
+
+		printf("\n%-6s %8s %-10s %10s %7s %10s %9s   (build %.2f ms)\n", "accel", "threads", "rays", "count", "hits", "ms", "Mrays/s", build_time);
+		for (string& threads_item : splitList(benchThreads)) {
+			unsigned int n_threads = max(atoi(threads_item.c_str()), 1);
+			size_t total_rays = 0;
+			double total_time = 0;
+
+			for (int t = 0; t < NUM_RAY_TYPES; t++) {
+				if (rays[t].empty()) continue;
+				std::atomic<size_t> next_block(0);
+				std::atomic<unsigned long long> hits(0);
+				vector<std::thread> workers;
+
+				auto replayStart = std::chrono::high_resolution_clock::now();
+				for (unsigned int i = 1; i < n_threads; i++)
+					workers.push_back(std::thread(replayRays, &rays[t], &next_block, &hits));
+				replayRays(&rays[t], &next_block, &hits);
+				for (std::thread& worker : workers)
+					worker.join();
+				double replay_time = elapsedMs(replayStart);
+
+				printf("%-6s %8u %-10s %10zu %6.1f%% %10.2f %9.3f\n", accel.c_str(), n_threads, type_names[t], rays[t].size(),
+					100.0 * hits / rays[t].size(), replay_time, rays[t].size() / (replay_time * 1000));
+				total_rays += rays[t].size();
+				total_time += replay_time;
+			}
+			printf("%-6s %8u %-10s %10zu %7s %10.2f %9.3f\n", accel.c_str(), n_threads, "all", total_rays, "",
+				total_time, total_rays / (total_time * 1000));
+		}
+
+		delete grid_ptr;
+		delete bvh_ptr;
+		grid_ptr = NULL;
+		bvh_ptr = NULL;
+	}
+	delete scene;
+	scene = NULL;
+	return true;
+}
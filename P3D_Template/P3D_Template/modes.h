@@ -0,0 +1,42 @@
+#ifndef MODES_H
+#define MODES_H
+
+/*
+ Headless modes that measure or check the renderer instead of producing images: the benchmark, the golden image
+ regression, the accelerator report and the ray replay. Their options are set from the command line.
+*/
+
+//Benchmark mode: the scenes of P3D_Scenes (or of the benchScenes list) under every accelerator, SPP and thread count of
+//the lists; results are written to benchOutput (.json or .csv). NONE is skipped for scenes with more than benchMaxObjectsNoAccel objects
+extern const char* benchScenes;
+extern const char* benchAccels;
+extern const char* benchSPP;
+extern const char* benchThreads;
+extern const char* benchOutput;
+extern const char* benchLabel;
+extern int benchMaxObjectsNoAccel;
+
+//Golden image regression mode: each scene of benchScenes (by default, of P3D_Scenes) is rendered at goldenSPP with every
+//accelerator of benchAccels and compared with its reference image, goldenDir/<scene>_spp<N><goldenExtension>, and with the
+//image of the first accelerator. An image fails below goldenPSNR dB or goldenSSIM, or when more than goldenMaxBadPixels
+//of its pixels differ by more than goldenTolerance in a channel. With goldenUpdate the references are rendered instead
+extern bool goldenUpdate;
+extern const char* goldenDir;
+extern const char* goldenExtension;
+extern int goldenSPP;
+extern double goldenPSNR;
+extern double goldenSSIM;
+extern int goldenTolerance;
+extern double goldenMaxBadPixels;
+
+//Accelerator report mode: the accelerators of benchAccels are built for each scene of benchScenes (by default, of
+//P3D_Scenes) and their quality reports printed, without rendering.
+//Replay mode: the rays of a capture are traced through each accelerator of benchAccels with each thread count of
+//benchThreads, without shading
+
+bool runBenchmark();   //false if a scene could not be loaded or the results could not be written
+int runGoldenRegression();   //number of failed checks
+bool runAccelReport();   //false if a scene could not be loaded
+bool runReplay(const char* file_name);   //false if the capture or its scene could not be loaded
+
+#endif
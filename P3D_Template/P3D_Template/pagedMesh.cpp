@@ -0,0 +1,740 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include "pagedMesh.h"
+#include "rayAccelerator.h"
+#include "maths.h"
+#include "allocCounter.h"
+
+#define PAGE_MAGIC "P3DPAGES"
+#define PAGE_VERSION 1
+#define PAGE_ALIGNMENT 65536   //mapping offsets must be multiple of the allocation granularity (64KB on Windows)
+
+struct PageFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_pages;
+};
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + PAGE_ALIGNMENT - 1) / PAGE_ALIGNMENT * PAGE_ALIGNMENT;
+}
+
+// Memory needed by a resident page: the Triangle objects, the pointer vectors of the page and of its BVH,
+// and the BVH nodes (leaves hold up to 25 triangles, each node is about 40 bytes)
+static size_t residentPageBytes(unsigned int n_tris) {
+	return n_tris * (sizeof(Triangle) + 2 * sizeof(Object*)) + (2 * n_tris / 25 + 1) * 40;
+}
+
+/////////////////////////////////////////////////////////////////////// FILE MAPPING
+
+struct MappedFile {
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+static MappedFile* openMapping(const char* name)
+{
+	MappedFile* mf = new MappedFile();
+#ifdef _WIN32
+	mf->file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (mf->file == INVALID_HANDLE_VALUE) {
+		delete mf;
+		return NULL;
+	}
+	mf->mapping = CreateFileMappingA(mf->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mf->mapping == NULL) {
+		CloseHandle(mf->file);
+		delete mf;
+		return NULL;
+	}
+#else
+	mf->fd = open(name, O_RDONLY);
+	if (mf->fd < 0) {
+		delete mf;
+		return NULL;
+	}
+#endif
+	return mf;
+}
+
+static void closeMapping(MappedFile* mf)
+{
+	if (mf == NULL) return;
+#ifdef _WIN32
+	CloseHandle(mf->mapping);
+	CloseHandle(mf->file);
+#else
+	close(mf->fd);
+#endif
+	delete mf;
+}
+
+static void* mapView(MappedFile* mf, uint64_t offset, size_t size)
+{
+#ifdef _WIN32
+	return MapViewOfFile(mf->mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFF), size);
+#else
+	void* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, mf->fd, (off_t)offset);
+	return view == MAP_FAILED ? NULL : view;
+#endif
+}
+
+static void unmapView(void* view, size_t size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+#else
+	munmap(view, size);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////// PAGE CACHE
+
+PageCache::PageCache(size_t budget_bytes) :
+	budget(budget_bytes), resident_bytes(0), peak_bytes(0), lookups(0), hits(0), faults(0), evictions(0), load_errors(0), bytes_mapped(0) {}
+
+PageCache::~PageCache()
+{
+	while (!lru.empty()) {
+		ResidentPage* resident = lru.front();
+		lru.pop_front();
+		Evict(resident);
+	}
+}
+
+PageCache::ResidentPage* PageCache::Acquire(PagedMesh* mesh, unsigned int page)
+{
+	unique_lock<mutex> guard(lock);
+
+	lookups++;
+	ResidentPage* resident = mesh->resident[page];
+	if (resident != NULL) {
+		hits++;
+		lru.splice(lru.begin(), lru, resident->lru_pos);
+		resident->pins++;
+		page_loaded.wait(guard, [resident] { return resident->loaded || resident->failed; });
+		if (resident->failed) {   //already out of the cache, the last thread to unpin it deletes it
+			if (--resident->pins == 0) delete resident;
+			return NULL;
+		}
+		return resident;
+	}
+
+	//page fault: make room for the page by evicting the least recently used pages that are not in use
+	faults++;
+	unsigned long long allocs_start = threadAllocations();   //paging, not an allocation of the render loop
+	size_t bytes = residentPageBytes(mesh->pages[page].n_tris);
+	list<ResidentPage*>::iterator it = lru.end();
+	while (resident_bytes + bytes > budget && it != lru.begin()) {
+		--it;
+		ResidentPage* victim = *it;
+		if (victim->pins > 0) continue;   //also the pages being loaded
+		it = lru.erase(it);
+		Evict(victim);
+	}
+
+	//the page enters the cache still loading, so that the other threads that need it wait for it
+	resident = new ResidentPage();
+	resident->mesh = mesh;
+	resident->page = page;
+	resident->bvh = NULL;
+	resident->pins = 1;
+	resident->loaded = resident->failed = false;
+	resident->bytes = bytes;
+	lru.push_front(resident);
+	resident->lru_pos = lru.begin();
+	mesh->resident[page] = resident;
+	resident_bytes += bytes;
+	if (resident_bytes > peak_bytes) peak_bytes = resident_bytes;
+
+	//the threads whose pages are resident go on rendering while this one loads its page
+	guard.unlock();
+	bool ok = mesh->Load(resident);
+	guard.lock();
+
+	if (ok) {
+		resident->loaded = true;
+		bytes_mapped += mesh->pages[page].n_tris * 9 * sizeof(float);
+	}
+	else {
+		resident->failed = true;
+		lru.erase(resident->lru_pos);
+		mesh->resident[page] = NULL;
+		resident_bytes -= bytes;
+		if (load_errors++ == 0)
+			printf("Error mapping page %u of the page file, its triangles are not rendered\n", page);
+	}
+	page_loaded.notify_all();
+	excludeThreadAllocations(threadAllocations() - allocs_start);
+
+	if (!ok) {
+		if (--resident->pins == 0) delete resident;
+		return NULL;
+	}
+	return resident;
+}
+
+void PageCache::Release(ResidentPage* resident)
+{
+	lock_guard<mutex> guard(lock);
+	resident->pins--;
+}
+
+//the page must already be out of the LRU list
+void PageCache::Evict(ResidentPage* resident)
+{
+	for (Object* obj : resident->triangles)
+		delete (Triangle*)obj;
+	delete resident->bvh;
+	resident->mesh->resident[resident->page] = NULL;
+	resident_bytes -= resident->bytes;
+	evictions++;
+	delete resident;
+}
+
+void PageCache::EvictAll(PagedMesh* mesh)
+{
+	lock_guard<mutex> guard(lock);
+	list<ResidentPage*>::iterator it = lru.begin();
+	while (it != lru.end()) {
+		ResidentPage* resident = *it;
+		if (resident->mesh == mesh) {
+			it = lru.erase(it);
+			Evict(resident);
+		}
+		else it++;
+	}
+}
+
+void PageCache::PrintStats()
+{
+	double hit_rate = lookups > 0 ? 100.0 * hits / lookups : 0.0;
+	printf("\nPAGING: lookups = %llu, hits = %llu, page faults = %llu, evictions = %llu, hit rate = %.2f%%\n", lookups, hits, faults, evictions, hit_rate);
+	printf("PAGING: budget = %.1f MB, resident = %.1f MB, peak resident = %.1f MB, total mapped = %.1f MB\n",
+		budget / 1048576.0, resident_bytes / 1048576.0, peak_bytes / 1048576.0, bytes_mapped / 1048576.0);
+	if (load_errors > 0)
+		printf("PAGING: %llu pages could not be loaded\n", load_errors);
+}
+
+/////////////////////////////////////////////////////////////////////// STREAMED BUILD
+
+#define MORTON_BITS 6   //per axis: the faces are sorted by the cell of their centroid in a 64^3 grid over the mesh
+#define BUILD_BUFFER_TRIS (1 << 20)   //faces sorted in memory at once while the pages are written (36 MB), at least
+#define MAX_BUILD_PASSES 256          //bucket files open at once; larger meshes sort more faces per pass
+
+//a face waiting in the faces file for its page
+struct BuildFace {
+	float v[9];
+	uint32_t cell;   //in the bucket files, the position of the face in the sorted order
+};
+
+struct PageBuilder {
+	string page_file, vertices_name, faces_name;
+	unsigned int n_vertices, vertices_added, tris_per_page;
+	FILE* vertices_out;       //the vertices, until the first face
+	MappedFile* vertices_file;
+	float* vertices;          //then mapped, 3 floats per vertex
+	FILE* faces;              //the faces in the order of the scene file
+	float min[3], max[3];     //bounding box of the vertices
+	vector<unsigned int> cell_faces;   //faces in each Morton cell
+};
+
+static void closeBuilder(PageBuilder* b)
+{
+	if (b->vertices_out != NULL) fclose(b->vertices_out);
+	if (b->vertices != NULL) unmapView(b->vertices, (size_t)b->n_vertices * 3 * sizeof(float));
+	closeMapping(b->vertices_file);
+	if (b->faces != NULL) fclose(b->faces);
+	remove(b->vertices_name.c_str());
+	remove(b->faces_name.c_str());
+	delete b;
+}
+
+//the first face maps the vertices, written to their file so far
+static bool mapBuildVertices(PageBuilder* b)
+{
+	bool ok = b->n_vertices > 0 && b->vertices_added == b->n_vertices && fclose(b->vertices_out) == 0;
+	b->vertices_out = NULL;
+	if (ok) b->vertices_file = openMapping(b->vertices_name.c_str());
+	if (b->vertices_file != NULL) b->vertices = (float*)mapView(b->vertices_file, 0, (size_t)b->n_vertices * 3 * sizeof(float));
+	if (b->vertices == NULL) {
+		printf("Error mapping the vertices of the mesh of %s\n", b->page_file.c_str());
+		return false;
+	}
+	return true;
+}
+
+//the MORTON_BITS low bits of x, with two zero bits between each of them
+static uint32_t spreadBits(uint32_t x)
+{
+	uint32_t spread = 0;
+	for (int b = 0; b < MORTON_BITS; b++)
+		spread |= ((x >> b) & 1) << (3 * b);
+	return spread;
+}
+
+bool PagedMesh::BeginBuild(const char* page_file, unsigned int n_vertices, unsigned int tris_per_page)
+{
+	builder = new PageBuilder();
+	builder->page_file = page_file;
+	builder->vertices_name = builder->page_file + ".vertices";
+	builder->faces_name = builder->page_file + ".faces";
+	builder->n_vertices = n_vertices;
+	builder->vertices_added = 0;
+	builder->tris_per_page = tris_per_page;
+	builder->vertices_file = NULL;
+	builder->vertices = NULL;
+	for (int k = 0; k < 3; k++) {
+		builder->min[k] = FLT_MAX;
+		builder->max[k] = -FLT_MAX;
+	}
+	builder->cell_faces.assign(1 << (3 * MORTON_BITS), 0);
+	builder->vertices_out = fopen(builder->vertices_name.c_str(), "wb");
+	builder->faces = fopen(builder->faces_name.c_str(), "w+b");
+	if (builder->vertices_out == NULL || builder->faces == NULL) {
+		printf("Error creating the temporary files of the page file %s\n", page_file);
+		return false;
+	}
+	return true;
+}
+
+bool PagedMesh::AddVertex(const Vector& vertex)
+{
+	float v[3] = { vertex.x, vertex.y, vertex.z };
+	for (int k = 0; k < 3; k++) {
+		if (v[k] < builder->min[k]) builder->min[k] = v[k];
+		if (v[k] > builder->max[k]) builder->max[k] = v[k];
+	}
+	builder->vertices_added++;
+	if (fwrite(v, sizeof(float), 3, builder->vertices_out) != 3) {
+		printf("Error writing the vertices of the mesh of %s\n", builder->page_file.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool PagedMesh::AddFace(unsigned int v0, unsigned int v1, unsigned int v2)
+{
+	if (builder->vertices == NULL && !mapBuildVertices(builder))
+		return false;
+	if (v0 >= builder->n_vertices || v1 >= builder->n_vertices || v2 >= builder->n_vertices) {
+		printf("Invalid vertex index in face %u of the mesh of %s\n", num_triangles + 1, builder->page_file.c_str());
+		return false;
+	}
+
+	BuildFace face;
+	unsigned int index[3] = { v0, v1, v2 };
+	for (int v = 0; v < 3; v++)
+		memcpy(face.v + 3 * v, builder->vertices + 3 * (size_t)index[v], 3 * sizeof(float));
+
+	const int cells_per_axis = 1 << MORTON_BITS;
+	face.cell = 0;
+	for (int k = 0; k < 3; k++) {
+		float centroid = (face.v[k] + face.v[3 + k] + face.v[6 + k]) / 3;
+		float extent = builder->max[k] - builder->min[k];
+		int c = extent > 0 ? (int)((centroid - builder->min[k]) / extent * cells_per_axis) : 0;
+		c = c < 0 ? 0 : (c >= cells_per_axis ? cells_per_axis - 1 : c);
+		face.cell |= spreadBits(c) << k;
+	}
+	builder->cell_faces[face.cell]++;
+	num_triangles++;
+
+	if (fwrite(&face, sizeof(face), 1, builder->faces) != 1) {
+		printf("Error writing the faces of the mesh of %s\n", builder->page_file.c_str());
+		return false;
+	}
+	return true;
+}
+
+// The faces are sorted by Morton cell, with a counting sort in passes of whole pages of at least BUILD_BUFFER_TRIS
+// faces: one sweep of the faces file sends each face to the bucket file of its pass, which is then sorted in memory,
+// so each face is read twice whatever the size of the mesh. The cells are split in halves, over each axis in turn, down to pages of at most tris_per_page faces
+bool PagedMesh::EndBuild()
+{
+	string page_name = builder->page_file;   //the builder is released before the page file is mapped
+	const char* page_file = page_name.c_str();
+	unsigned int tris_per_page = builder->tris_per_page;
+	if (num_triangles == 0) {
+		printf("Error: the mesh of %s has no faces\n", page_file);
+		return false;
+	}
+
+	//first position of the faces of each cell in the sorted order
+	vector<unsigned int> cell_start(builder->cell_faces.size() + 1);
+	unsigned int position = 0;
+	for (size_t c = 0; c < builder->cell_faces.size(); c++) {
+		cell_start[c] = position;
+		position += builder->cell_faces[c];
+	}
+	cell_start.back() = position;
+
+	//top-level tree and first position of each page
+	vector<unsigned int> page_bounds;
+	page_bounds.push_back(0);
+	nodes.clear();
+	buildTree(cell_start, 0, builder->cell_faces.size(), tris_per_page, page_bounds);
+
+	//page table: location of each page in the file; the bounds are found while the pages are written
+	unsigned int n_pages = page_bounds.size() - 1;
+	pages.resize(n_pages);
+	uint64_t offset = alignOffset(sizeof(PageFileHeader) + n_pages * sizeof(PageRecord));
+	for (unsigned int p = 0; p < n_pages; p++) {
+		PageRecord& rec = pages[p];
+		rec.n_tris = page_bounds[p + 1] - page_bounds[p];
+		rec.offset = offset;
+		rec.pad = 0;
+		for (int k = 0; k < 3; k++) {
+			rec.min[k] = FLT_MAX;
+			rec.max[k] = -FLT_MAX;
+		}
+		offset = alignOffset(offset + rec.n_tris * 9 * sizeof(float));
+	}
+
+	FILE* out = fopen(page_file, "wb");
+	if (out == NULL) {
+		printf("Error creating the page file %s\n", page_file);
+		return false;
+	}
+
+	PageFileHeader header;
+	memcpy(header.magic, PAGE_MAGIC, 8);
+	header.version = PAGE_VERSION;
+	header.n_pages = n_pages;
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(pages.data(), sizeof(PageRecord), n_pages, out);
+
+	//passes of whole pages, at most MAX_BUILD_PASSES of them: the first page of each pass, then n_pages
+	size_t pass_tris = BUILD_BUFFER_TRIS;
+	vector<unsigned int> pass_pages;
+	while (true) {
+		pass_pages.assign(1, 0);
+		for (unsigned int first = 0, last; first < n_pages; first = last) {
+			last = first + 1;
+			while (last < n_pages && page_bounds[last + 1] - page_bounds[first] <= pass_tris)
+				last++;
+			pass_pages.push_back(last);
+		}
+		if (pass_pages.size() - 1 <= MAX_BUILD_PASSES) break;
+		pass_tris *= 2;
+	}
+	unsigned int n_passes = pass_pages.size() - 1;
+
+	//with several passes, each face goes with its sorted position to the bucket file of its pass; a single pass
+	//sorts the faces file itself
+	bool ok = true;
+	vector<BuildFace> chunk(4096);
+	vector<unsigned int> cursor = cell_start;
+	vector<FILE*> buckets(n_passes, (FILE*)NULL);
+	vector<string> bucket_names(n_passes);
+	if (n_passes > 1) {
+		vector<unsigned int> pass_start(n_passes);   //first position of each pass
+		for (unsigned int p = 0; p < n_passes; p++) {
+			pass_start[p] = page_bounds[pass_pages[p]];
+			bucket_names[p] = page_name + ".pass" + to_string(p);
+			buckets[p] = fopen(bucket_names[p].c_str(), "w+b");
+			if (buckets[p] == NULL) ok = false;
+		}
+		rewind(builder->faces);
+		size_t n;
+		while (ok && (n = fread(chunk.data(), sizeof(BuildFace), chunk.size(), builder->faces)) > 0)
+			for (size_t i = 0; i < n; i++) {
+				chunk[i].cell = cursor[chunk[i].cell]++;
+				unsigned int pass = upper_bound(pass_start.begin(), pass_start.end(), chunk[i].cell) - pass_start.begin() - 1;
+				fwrite(&chunk[i], sizeof(BuildFace), 1, buckets[pass]);
+			}
+		ok = ok && !ferror(builder->faces);
+		for (unsigned int p = 0; ok && p < n_passes; p++)
+			ok = !ferror(buckets[p]);   //before rewind clears it
+		fclose(builder->faces);   //no longer needed: its disk space is released before the pages are written
+		builder->faces = NULL;
+		remove(builder->faces_name.c_str());
+	}
+
+	//page data: the 3 vertices of each triangle, padded up to the next aligned offset
+	uint64_t written = sizeof(PageFileHeader) + n_pages * sizeof(PageRecord);
+	vector<float> data;
+	vector<char> padding(PAGE_ALIGNMENT, 0);
+	for (unsigned int pass = 0; ok && pass < n_passes; pass++) {
+		unsigned int first = pass_pages[pass], last = pass_pages[pass + 1];
+		unsigned int lo = page_bounds[first], hi = page_bounds[last];
+
+		//the faces of this pass, in the order of their positions
+		data.resize((size_t)(hi - lo) * 9);
+		FILE* in = n_passes > 1 ? buckets[pass] : builder->faces;
+		rewind(in);
+		size_t n;
+		while ((n = fread(chunk.data(), sizeof(BuildFace), chunk.size(), in)) > 0)
+			for (size_t i = 0; i < n; i++) {
+				unsigned int pos = n_passes > 1 ? chunk[i].cell : cursor[chunk[i].cell]++;
+				memcpy(&data[(size_t)(pos - lo) * 9], chunk[i].v, 9 * sizeof(float));
+			}
+		ok = !ferror(in);
+		if (n_passes > 1) {   //each bucket file is released once sorted
+			fclose(buckets[pass]);
+			remove(bucket_names[pass].c_str());
+			buckets[pass] = NULL;
+		}
+
+		float* page_data = data.data();
+		for (unsigned int p = first; p < last; p++) {
+			PageRecord& rec = pages[p];
+			for (unsigned int i = 0; i < rec.n_tris * 3; i++)
+				for (int k = 0; k < 3; k++) {
+					float value = page_data[3 * i + k];
+					if (value < rec.min[k]) rec.min[k] = value;
+					if (value > rec.max[k]) rec.max[k] = value;
+				}
+			fwrite(padding.data(), 1, (size_t)(rec.offset - written), out);
+			fwrite(page_data, sizeof(float), rec.n_tris * 9, out);
+			written = rec.offset + rec.n_tris * 9 * sizeof(float);
+			page_data += rec.n_tris * 9;
+		}
+	}
+	for (unsigned int p = 0; p < n_passes; p++)   //after an error
+		if (buckets[p] != NULL) {
+			fclose(buckets[p]);
+			remove(bucket_names[p].c_str());
+		}
+
+	//the page table again, now with the bounds
+	fseek(out, sizeof(PageFileHeader), SEEK_SET);
+	fwrite(pages.data(), sizeof(PageRecord), n_pages, out);
+	ok = ok && !ferror(out);
+	fclose(out);
+	closeBuilder(builder);
+	builder = NULL;
+	if (!ok) {
+		printf("Error writing the page file %s\n", page_file);
+		return false;
+	}
+
+	//bounding boxes of the top-level tree, children are always stored after their parent
+	for (int n = nodes.size() - 1; n >= 0; n--) {
+		PageNode& node = nodes[n];
+		if (node.page >= 0) {
+			Vector page_min = Vector(pages[node.page].min[0], pages[node.page].min[1], pages[node.page].min[2]);
+			Vector page_max = Vector(pages[node.page].max[0], pages[node.page].max[1], pages[node.page].max[2]);
+			page_min -= EPSILON;
+			page_max += EPSILON;
+			node.bbox = AABB(page_min, page_max);
+		}
+		else {
+			node.bbox = nodes[node.left].bbox;
+			node.bbox.extend(nodes[node.right].bbox);
+		}
+	}
+
+	file = openMapping(page_file);
+	if (file == NULL) {
+		printf("Error mapping the page file %s\n", page_file);
+		return false;
+	}
+	resident.assign(n_pages, NULL);
+
+	printf("\nPAGED MESH: %u triangles in %u pages written to %s\n", num_triangles, n_pages, page_file);
+	return true;
+}
+
+// Median split of the Morton cells [first_cell, last_cell), a power of two of them, until their faces fit in a page
+// or a single cell is left. Returns the index of the top-level node of the cells.
+int PagedMesh::buildTree(const vector<unsigned int>& cell_start, unsigned int first_cell, unsigned int last_cell, unsigned int tris_per_page, vector<unsigned int>& page_bounds)
+{
+	unsigned int first = cell_start[first_cell], last = cell_start[last_cell];
+	if (last - first <= tris_per_page || last_cell - first_cell == 1)
+		return buildPages(first, last, tris_per_page, page_bounds);
+
+	//an empty half gets no node
+	unsigned int split_cell = first_cell + (last_cell - first_cell) / 2;
+	if (cell_start[split_cell] == first)
+		return buildTree(cell_start, split_cell, last_cell, tris_per_page, page_bounds);
+	if (cell_start[split_cell] == last)
+		return buildTree(cell_start, first_cell, split_cell, tris_per_page, page_bounds);
+
+	int node_index = nodes.size();
+	nodes.push_back(PageNode());
+	int left = buildTree(cell_start, first_cell, split_cell, tris_per_page, page_bounds);
+	int right = buildTree(cell_start, split_cell, last_cell, tris_per_page, page_bounds);
+	nodes[node_index].left = left;
+	nodes[node_index].right = right;
+	nodes[node_index].page = -1;
+	return node_index;
+}
+
+// Pages of the faces at the sorted positions [first, last): a single page, or the faces of a cell with more than
+// tris_per_page faces cut in several ones. Returns the index of the top-level node of the pages.
+int PagedMesh::buildPages(unsigned int first, unsigned int last, unsigned int tris_per_page, vector<unsigned int>& page_bounds)
+{
+	int node_index = nodes.size();
+	nodes.push_back(PageNode());
+	nodes[node_index].left = nodes[node_index].right = -1;
+
+	if (last - first <= tris_per_page) {
+		nodes[node_index].page = page_bounds.size() - 1;
+		page_bounds.push_back(last);
+		return node_index;
+	}
+
+	unsigned int n_pages = (last - first + tris_per_page - 1) / tris_per_page;
+	unsigned int split = first + n_pages / 2 * tris_per_page;
+	int left = buildPages(first, split, tris_per_page, page_bounds);
+	int right = buildPages(split, last, tris_per_page, page_bounds);
+	nodes[node_index].left = left;
+	nodes[node_index].right = right;
+	nodes[node_index].page = -1;
+	return node_index;
+}
+
+/////////////////////////////////////////////////////////////////////// PAGED MESH
+
+thread_local vector<PagedMesh::LastRay> PagedMesh::lastRays;
+unsigned int PagedMesh::num_meshes = 0;
+
+PagedMesh::PagedMesh(PageCache* cache_) : cache(cache_), builder(NULL), file(NULL), num_triangles(0), id(num_meshes++) {}
+
+PagedMesh::~PagedMesh()
+{
+	if (builder != NULL)
+		closeBuilder(builder);
+	cache->EvictAll(this);
+	closeMapping(file);
+}
+
+// Maps the page data, creates its triangles and builds the bottom-level BVH; false if the page can not be mapped
+bool PagedMesh::Load(PageCache::ResidentPage* resident)
+{
+	PageRecord& rec = pages[resident->page];
+	size_t size = rec.n_tris * 9 * sizeof(float);
+	float* data = (float*)mapView(file, rec.offset, size);
+	if (data == NULL)
+		return false;
+
+	resident->triangles.reserve(rec.n_tris);
+	for (unsigned int i = 0; i < rec.n_tris; i++) {
+		float* v = data + 9 * i;
+		Vector P0 = Vector(v[0], v[1], v[2]);
+		Vector P1 = Vector(v[3], v[4], v[5]);
+		Vector P2 = Vector(v[6], v[7], v[8]);
+		Triangle* triangle = new Triangle(P0, P1, P2);
+		triangle->SetMaterialId(m_MaterialId);
+		resident->triangles.push_back((Object*)triangle);
+	}
+	unmapView(data, size);
+
+	resident->bvh = new BVH();
+	resident->bvh->Build(resident->triangles);
+	return true;
+}
+
+bool PagedMesh::interceptsPage(unsigned int page, Ray& r, float& t, Vector& normal)
+{
+	PageCache::ResidentPage* resident = cache->Acquire(this, page);
+	if (resident == NULL)   //the page could not be loaded
+		return false;
+
+	Ray localRay = r;  //the BVH traversal takes the ray by reference
+	Object* hitObj = NULL;
+	Vector hitPoint;
+	bool hit = resident->bvh->Traverse(localRay, &hitObj, hitPoint);
+	if (hit) {
+		normal = hitObj->getNormal(hitPoint);
+		t = ((hitPoint - r.origin) * r.direction) / (r.direction * r.direction);  //same ray parameterization as the caller
+	}
+
+	cache->Release(resident);
+	return hit;
+}
+
+// Slot of the mesh in the last rays of the calling thread; the table is grown, once per thread and scene, outside
+// the allocations of the render loop
+PagedMesh::LastRay& PagedMesh::lastRay()
+{
+	if (id >= lastRays.size()) {
+		unsigned long long allocs_start = threadAllocations();
+		lastRays.resize(num_meshes);   //the new slots are zeroed: no mesh
+		excludeThreadAllocations(threadAllocations() - allocs_start);
+	}
+	return lastRays[id];
+}
+
+// Front-to-back traversal of the top-level tree: pages are only loaded if their box is closer than the closest hit
+bool PagedMesh::intercepts(Ray& r, float& t)
+{
+	LastRay& last = lastRay();
+	if (last.mesh == this && r.origin.x == last.origin.x && r.origin.y == last.origin.y && r.origin.z == last.origin.z &&
+		r.direction.x == last.direction.x && r.direction.y == last.direction.y && r.direction.z == last.direction.z) {
+		if (last.hit) t = last.t;
+		return last.hit;
+	}
+
+	int stack_node[64];
+	float stack_t[64];
+	int top = 0;
+	float t_closest = FLT_MAX, t_node, t_left, t_right, t_page;
+	Vector normal, hit_normal;
+	bool hit = false;
+
+	if (nodes[0].bbox.intercepts(r, t_node)) {
+		stack_node[top] = 0;
+		stack_t[top++] = nodes[0].bbox.isInside(r.origin) ? 0 : t_node;
+	}
+
+	while (top > 0) {
+		top--;
+		PageNode& node = nodes[stack_node[top]];
+		if (stack_t[top] > t_closest) continue;
+
+		if (node.page >= 0) {
+			if (interceptsPage(node.page, r, t_page, normal) && t_page < t_closest) {
+				t_closest = t_page;
+				hit_normal = normal;
+				hit = true;
+			}
+			continue;
+		}
+
+		bool left_hit = nodes[node.left].bbox.intercepts(r, t_left);
+		bool right_hit = nodes[node.right].bbox.intercepts(r, t_right);
+		if (left_hit && nodes[node.left].bbox.isInside(r.origin)) t_left = 0;
+		if (right_hit && nodes[node.right].bbox.isInside(r.origin)) t_right = 0;
+
+		//push the farthest child first so that the closest one is visited next
+		if (left_hit && right_hit && t_left < t_right) {
+			stack_node[top] = node.right; stack_t[top++] = t_right;
+			stack_node[top] = node.left; stack_t[top++] = t_left;
+		}
+		else {
+			if (left_hit) { stack_node[top] = node.left; stack_t[top++] = t_left; }
+			if (right_hit) { stack_node[top] = node.right; stack_t[top++] = t_right; }
+		}
+	}
+
+	last.mesh = this;
+	last.origin = r.origin;
+	last.direction = r.direction;
+	last.normal = hit_normal;
+	last.hit = hit;
+	last.t = t_closest;
+	if (hit) t = t_closest;
+	return hit;
+}
+
+Vector PagedMesh::getNormal(Vector point)
+{
+	return lastRay().normal;
+}
@@ -0,0 +1,128 @@
+#ifndef PAGED_MESH_H
+#define PAGED_MESH_H
+
+#include <vector>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "scene.h"
+
+using namespace std;
+
+/*
+ Out-of-core meshes.
+ A large mesh is streamed, face by face, into spatially coherent pages of triangles which are written to a page
+ file; only its vertices are kept, in a mapped file, while the pages are built. The mesh is a
+ single scene object that keeps in memory only the page table and the top-level tree of the page bounding boxes;
+ the triangles of a page are brought into memory through a file mapping when a ray first reaches the page, and a
+ bottom-level BVH is then built for them. A PageCache shared by all the meshes of the scene keeps the resident
+ pages under a memory budget by evicting the least recently used ones. A page is loaded outside the lock of the
+ cache, so a page fault only stops the threads that need that page.
+*/
+
+class BVH;
+class PagedMesh;
+struct MappedFile;
+struct PageBuilder;
+
+class PageCache
+{
+public:
+	struct ResidentPage {
+		PagedMesh* mesh;
+		unsigned int page;
+		vector<Object*> triangles;
+		BVH* bvh;
+		size_t bytes;
+		int pins;
+		bool loaded, failed;   //until loaded, the threads that need the page wait for the thread that loads it
+		list<ResidentPage*>::iterator lru_pos;
+	};
+
+	PageCache(size_t budget_bytes);
+	~PageCache();
+
+	ResidentPage* Acquire(PagedMesh* mesh, unsigned int page);  //page is pinned until Release; NULL if it could not be loaded
+	void Release(ResidentPage* resident);
+	void EvictAll(PagedMesh* mesh);
+	void PrintStats();
+
+private:
+	void Evict(ResidentPage* resident);
+
+	mutex lock;
+	condition_variable page_loaded;
+	list<ResidentPage*> lru;   //most recently used at the front
+	size_t budget, resident_bytes, peak_bytes;
+	unsigned long long lookups, hits, faults, evictions, load_errors;
+	unsigned long long bytes_mapped;
+};
+
+class PagedMesh : public Object
+{
+public:
+	PagedMesh(PageCache* cache);
+	~PagedMesh();
+
+	//Streamed build: the vertices, then the faces (0-based vertex indices) are added one at a time; EndBuild sorts
+	//the faces in pages of at most tris_per_page, writes them to page_file and maps it. Errors are printed.
+	bool BeginBuild(const char* page_file, unsigned int n_vertices, unsigned int tris_per_page);
+	bool AddVertex(const Vector& vertex);
+	bool AddFace(unsigned int v0, unsigned int v1, unsigned int v2);
+	bool EndBuild();
+
+	bool intercepts(Ray& r, float& t);
+	Vector getNormal(Vector point);
+	AABB GetBoundingBox() { return nodes[0].bbox; }
+
+	int getNumPages() { return pages.size(); }
+	unsigned int getNumTriangles() { return num_triangles; }
+
+private:
+	friend class PageCache;
+
+	struct PageRecord {
+		float min[3], max[3];
+		uint64_t offset;   // offset of the page data in the page file, aligned to PAGE_ALIGNMENT
+		uint32_t n_tris;
+		uint32_t pad;
+	};
+
+	//top-level tree: the hierarchy of the spatial clustering, with a page in each leaf
+	struct PageNode {
+		AABB bbox;
+		int left, right;   //children indices, -1 for leaves
+		int page;
+	};
+
+	int buildTree(const vector<unsigned int>& cell_start, unsigned int first_cell, unsigned int last_cell, unsigned int tris_per_page, vector<unsigned int>& page_bounds);
+	int buildPages(unsigned int first, unsigned int last, unsigned int tris_per_page, vector<unsigned int>& page_bounds);
+	bool Load(PageCache::ResidentPage* resident);
+	bool interceptsPage(unsigned int page, Ray& r, float& t, Vector& normal);
+
+	PageCache* cache;
+	PageBuilder* builder;   //only during the build
+	MappedFile* file;
+	vector<PageRecord> pages;
+	vector<PageNode> nodes;
+	vector<PageCache::ResidentPage*> resident;   //indexed by page, NULL when the page is not in memory
+	unsigned int num_triangles;
+
+	//last ray tested by each rendering thread: the Grid tests the mesh again in every cell it overlaps,
+	//and getNormal returns the normal of the last hit. Each mesh has its own slot, lastRays[id], so that the
+	//meshes tested on the same ray do not overwrite each other's hit; a thread grows its table on its first ray.
+	struct LastRay {
+		const PagedMesh* mesh;
+		Vector origin, direction, normal;
+		bool hit;
+		float t;
+	};
+	static thread_local vector<LastRay> lastRays;
+	static unsigned int num_meshes;
+	unsigned int id;
+
+	LastRay& lastRay();
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+bool perfEnabled = false;
+
+static const char* counterNames[NUM_PERF_COUNTERS] = { "cycles", "instructions", "L1D misses", "LLC misses", "dTLB misses", "branch misses" };
+static const char* phaseNames[NUM_PERF_PHASES] = { "build", "render", "encode" };
+
+static bool counterAvailable[NUM_PERF_COUNTERS];
+static double totals[NUM_PERF_PHASES][NUM_PERF_COUNTERS];
+static std::mutex perfLock;
+
+#ifdef __linux__
+
+static int openCounter(int counter)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;   //to scale the counts when the PMU is multiplexed
+
+	switch (counter) {
+	case PERF_CYCLES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+	case PERF_INSTRUCTIONS: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+	case PERF_L1D_MISSES:
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case PERF_LLC_MISSES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+	case PERF_DTLB_MISSES:
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	default: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+	}
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);   //calling thread, on any CPU
+}
+
+// Counters of a thread, opened on its first scope and closed when the thread exits
+struct ThreadCounters {
+	int fd[NUM_PERF_COUNTERS];
+	bool opened;
+
+	ThreadCounters() : opened(false) {}
+	~ThreadCounters()
+	{
+		if (!opened) return;
+		for (int c = 0; c < NUM_PERF_COUNTERS; c++)
+			if (fd[c] >= 0) close(fd[c]);
+	}
+
+	void open()
+	{
+		opened = true;
+		for (int c = 0; c < NUM_PERF_COUNTERS; c++)
+			fd[c] = counterAvailable[c] ? openCounter(c) : -1;
+	}
+
+	void read(uint64_t values[NUM_PERF_COUNTERS][3])
+	{
+		for (int c = 0; c < NUM_PERF_COUNTERS; c++)
+			if (fd[c] < 0 || ::read(fd[c], values[c], 3 * sizeof(uint64_t)) != 3 * sizeof(uint64_t))
+				values[c][0] = values[c][1] = values[c][2] = 0;
+	}
+};
+
+static thread_local ThreadCounters threadCounters;
+
+bool perfOpen()
+{
+	int n_available = 0;
+	for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+		int fd = openCounter(c);
+		counterAvailable[c] = fd >= 0;
+		if (fd >= 0) {
+			close(fd);
+			n_available++;
+		}
+	}
+
+	perfEnabled = n_available > 0;
+	if (!perfEnabled)
+		printf("Hardware performance counters are not available (no PMU or perf_event_paranoid too high); -perf ignored\n");
+	return perfEnabled;
+}
+
+void PerfScope::begin()
+{
+	if (!threadCounters.opened) threadCounters.open();
+	threadCounters.read(start);
+	active = true;
+}
+
+void PerfScope::end()
+{
+	uint64_t stop[NUM_PERF_COUNTERS][3];
+	threadCounters.read(stop);
+
+	std::lock_guard<std::mutex> guard(perfLock);
+	for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+		double value = (double)(stop[c][0] - start[c][0]);
+		uint64_t enabled = stop[c][1] - start[c][1], running = stop[c][2] - start[c][2];
+		if (running > 0 && running < enabled) value *= (double)enabled / running;
+		totals[phase][c] += value;
+	}
+}
+
+#else
+
+bool perfOpen()
+{
+	printf("Hardware performance counters are only read on Linux; -perf ignored\n");
+	return false;
+}
+
+void PerfScope::begin() {}
+void PerfScope::end() {}
+
+#endif
+
+void resetPerfCounters()
+{
+	std::lock_guard<std::mutex> guard(perfLock);
+	memset(totals, 0, sizeof(totals));
+}
+
+void printPerfCounters(unsigned long long rays)
+{
+	if (!perfEnabled) return;
+
+	std::lock_guard<std::mutex> guard(perfLock);
+	printf("\nPERF COUNTERS   ");
+	for (int p = 0; p < NUM_PERF_PHASES; p++)
+		printf("  %14s", phaseNames[p]);
+	printf("  %14s\n", "render per ray");
+
+	for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+		printf("  %-14s", counterNames[c]);
+		for (int p = 0; p < NUM_PERF_PHASES; p++) {
+			if (counterAvailable[c]) printf("  %14.0f", totals[p][c]);
+			else printf("  %14s", "n/a");
+		}
+		if (counterAvailable[c] && rays > 0) printf("  %14.3f\n", totals[PERF_RENDER][c] / rays);
+		else printf("  %14s\n", "n/a");
+	}
+
+	printf("  %-14s", "IPC");
+	for (int p = 0; p < NUM_PERF_PHASES; p++) {
+		double cycles = totals[p][PERF_CYCLES];
+		if (counterAvailable[PERF_CYCLES] && counterAvailable[PERF_INSTRUCTIONS] && cycles > 0)
+			printf("  %14.3f", totals[p][PERF_INSTRUCTIONS] / cycles);
+		else printf("  %14s", "n/a");
+	}
+	printf("\n");
+}
@@ -0,0 +1,46 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+/*
+ Hardware performance counters through Linux perf_event_open: cycles, instructions, L1 data cache read misses, last
+ level cache misses, data TLB read misses and branch misses, counted in user space per thread. A PerfScope counts the calling thread over
+ its lifetime and adds the counts to the totals of its phase (accelerator build, render or image encode); each thread
+ opens its counters the first time it enters a scope and closes them when it exits.
+ Counting is on once perfOpen succeeds. Where the counters cannot be opened (not Linux, no PMU as in most virtual
+ machines, or perf_event_paranoid too high) perfOpen fails and a PerfScope only tests a flag.
+*/
+
+typedef enum { PERF_BUILD, PERF_RENDER, PERF_ENCODE, NUM_PERF_PHASES } PerfPhase;
+
+typedef enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES, NUM_PERF_COUNTERS } PerfCounter;
+
+extern bool perfEnabled;
+
+bool perfOpen();
+void resetPerfCounters();
+void printPerfCounters(unsigned long long rays);   //rays traced in the render phase, for the misses per ray
+
+class PerfScope
+{
+public:
+	PerfScope(PerfPhase phase_) : phase(phase_), active(false)
+	{
+		if (perfEnabled) begin();
+	}
+	~PerfScope()
+	{
+		if (active) end();
+	}
+
+private:
+	void begin();
+	void end();
+
+	PerfPhase phase;
+	bool active;
+	uint64_t start[NUM_PERF_COUNTERS][3];   //value, time enabled and time running of each counter when the scope began
+};
+
+#endif
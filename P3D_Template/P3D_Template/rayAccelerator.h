@@ -5,9 +5,42 @@
 #include <queue>
 #include <cmath>
 #include "scene.h"
+#include "hugePages.h"
 
 using namespace std;
 
+// Objects without a finite box, such as planes, are kept out of the grid and the BVH, whose boxes would clip them, and
+// are tested on every ray next to the structure
+inline Object* closestUnbounded(const vector<Object*>& unbounded, Ray& ray, float& t_closest)
+{
+	Object* closest = NULL;
+	float t;
+	for (Object* obj : unbounded)
+		if (obj->intercepts(ray, t) && t < t_closest) {
+			t_closest = t;
+			closest = obj;
+		}
+	return closest;
+}
+
+inline bool anyUnbounded(const vector<Object*>& unbounded, Ray& ray, double length)
+{
+	float t;
+	for (Object* obj : unbounded)
+		if (obj->intercepts(ray, t) && t < length)
+			return true;
+	return false;
+}
+
+// Hit of the traversals that end outside the structure: the closest unbounded object, if any
+inline bool unboundedHit(Object* obj, float t, Ray& ray, Object** hit_obj, Vector& hit_point)
+{
+	if (obj == NULL) return false;
+	*hit_obj = obj;
+	hit_point = ray.origin + ray.direction * t;
+	return true;
+}
+
 class Grid
 {
 public:
@@ -21,9 +54,20 @@ public:
 	bool Traverse(Ray& ray, Object **hitobject, Vector& hitpoint);  //(const Ray& ray, double& tmin, ShadeRec& sr)
 	bool Traverse(Ray& ray);  //Traverse for shadow ray
 
+	void setDensity(float m_) { m = m_; }   //before Build
+	void PrintReport();   //cells, empty cells, objects per cell, duplicate references and memory
+	size_t GetMemory();   //bytes of the cell offsets and the object references
+
+	//Bytes the grid of objs would take once built, from its cell count and the cells each object overlaps, and at the
+	//peak of its build, which also copies the object list; SIZE_MAX when the cells would not fit in an int. Before Build
+	size_t EstimateMemory(vector<Object*>& objs, size_t& build_peak);
+
 private:
 	vector<Object *> objects;
-	vector<vector<Object*> > cells;
+	vector<Object*> unbounded;   //tested on every ray, outside the cells
+	//cells in compressed rows: the objects of cell c are cell_objects[cell_start[c]] up to cell_objects[cell_start[c + 1]]
+	vector<unsigned int, HugePageAllocator<unsigned int> > cell_start;
+	vector<Object*, HugePageAllocator<Object*> > cell_objects;
 
 	int nx, ny, nz; // number of cells in the x, y, and z directions
 	float m = 2.0f; // factor that allows to vary the number of cells
@@ -36,6 +80,13 @@ private:
 };
 
 /*********************************BVH*****************************************************************/
+
+//Deepest level of a BVH: nodes at this depth are made leaves whatever their number of objects, so that the traversal
+//stacks, which hold at most one node per level, are fixed arrays on the C stack rather than heap allocations
+#define BVH_MAX_DEPTH 64
+
+//Child reference of a quantized node that points to a leaf: the low bits are the first object of the leaf
+#define QBVH_LEAF 0x80000000u
 class BVH
 {
 	class Comparator {
@@ -68,21 +119,57 @@ class BVH
 		AABB& getAABB() { return bbox; };
 	};
 
+	typedef vector<BVHNode, HugePageAllocator<BVHNode> > NodeBuffer;
+
+	//Inner node of the quantized tree, 24 bytes against 96 for the two BVHNodes of its children: the boxes of the
+	//children as 8-bit offsets in its own box, rounded outwards so that a decoded box always contains the exact one,
+	//and the children, inner nodes (index in qnodes) or leaves (QBVH_LEAF | first object, with their number of objects)
+	struct QuantizedNode {
+		unsigned char lo[2][3], hi[2][3];   //per child and axis: steps from the min and from the max of the node
+		unsigned int child[2];
+		unsigned short n_objs[2];
+	};
+
+	//Decoded box of the quantized tree, plain floats so that the traversal copies and tests it inline
+	struct QBox {
+		float min[3], max[3];
+	};
+
 private:
 	int Threshold = 25;
-	vector<Object*> objects;
-	vector<BVH::BVHNode*> nodes;
+	bool quantized = false;
+	vector<Object*, HugePageAllocator<Object*> > objects;
+	vector<Object*> unbounded;   //tested on every ray, outside the tree
+	NodeBuffer nodes;   //the children of a node are next to each other; the root is nodes[0]
+	vector<QuantizedNode, HugePageAllocator<QuantizedNode> > qnodes;   //quantized tree, replaces nodes once built; the root is qnodes[0]
+	QBox qroot_bbox;
 
 	struct StackItem {
 		BVHNode* ptr;
 		float t;
+		StackItem() { }
 		StackItem(BVHNode* _ptr, float _t) : ptr(_ptr), t(_t) { }
 	};
 
-	stack<StackItem> hit_stack;
+	//Node of the quantized tree to visit, with its decoded box
+	struct QStackItem {
+		unsigned int ref;   //qnodes index, or QBVH_LEAF | first object
+		unsigned int n_objs;
+		QBox bbox;
+		float t;
+		QStackItem() { }
+		QStackItem(unsigned int _ref, unsigned int _n_objs, const QBox& _bbox, float _t) : ref(_ref), n_objs(_n_objs), bbox(_bbox), t(_t) { }
+	};
+
+	unsigned int quantize(unsigned int node_index, const QBox& bbox);
+	static void decodeBox(const QBox& parent, const QuantizedNode& node, int child, QBox& bbox);
+	bool TraverseQuantized(Ray& ray, Object** hit_obj, Vector& hit_point);
+	bool TraverseQuantized(Ray& ray);
+	void decodeNodes(NodeBuffer& tree);   //float nodes of the decoded boxes of the quantized tree
 
 public:
 	BVH(void);
+	~BVH(void);
 	int getNumObjects();
 	
 	void Build(vector<Object*>& objects);
@@ -90,8 +177,20 @@ public:
 	void sortByAxis(int largestAxis, int left_index, int right_index);
 	int getSplitIndex(float midPoint, int largestIndex, int left_index, int right_index);
 	AABB GetNodeBB(int left_index, int right_index);
-	void build_recursive(int left_index, int right_index, BVHNode* node);
+	void build_recursive(int left_index, int right_index, int node_index, int depth);
 	bool Traverse(Ray& ray, Object** hit_obj, Vector& hit_point); // closest hit
 	bool Traverse(Ray& ray); // shadow ray
+
+	void setThreshold(int threshold) { Threshold = threshold; }   //maximum objects per leaf, before Build
+	void setQuantized(bool quantized_) { quantized = quantized_; }   //before Build
+	void PrintReport();   //nodes, depths, leaf sizes, SAH cost, sibling overlap and memory
+	size_t GetMemory();   //bytes of the nodes and the object list
+
+	//Bytes the BVH of n objects is expected to take once built, about 4n / Threshold nodes, and at the peak of its
+	//build, with the node buffer of the worst case (2n - 1 nodes). After setThreshold and setQuantized, before Build
+	size_t EstimateMemory(size_t n_objects, size_t& build_peak);
 };
+
+//Histogram of sizes (objects per cell or leaf) in power-of-two buckets: 0, 1, 2-3, 4-7, ...
+void printSizeHistogram(const char* title, const vector<unsigned int>& sizes);
 #endif
\ No newline at end of file
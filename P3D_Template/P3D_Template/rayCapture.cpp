@@ -0,0 +1,117 @@
+#include <string.h>
+#include <stddef.h>
+#include "rayCapture.h"
+
+#define CAPTURE_MAGIC "P3DRAYS"
+#define CAPTURE_VERSION 1
+#define CAPTURE_BLOCK 4096   //rays buffered by a thread before they are written
+
+struct CaptureHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t count;
+	char scene[256];
+};
+
+static thread_local vector<CapturedRay> threadRays;
+
+RayCapture::RayCapture() : file(NULL), count(0), failed(false) {}
+
+RayCapture::~RayCapture()
+{
+	if (file) Close();
+}
+
+bool RayCapture::Open(const char* file_name, const string& scene)
+{
+	file = fopen(file_name, "wb");
+	if (file == NULL) {
+		printf("Error opening the ray capture file %s\n", file_name);
+		return false;
+	}
+
+	CaptureHeader header;
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, CAPTURE_MAGIC);
+	header.version = CAPTURE_VERSION;
+	header.record_size = sizeof(CapturedRay);
+	strncpy(header.scene, scene.c_str(), sizeof(header.scene) - 1);
+
+	count = 0;
+	failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	threadRays.clear();
+	return !failed;
+}
+
+void RayCapture::Record(const Ray& ray, float tmax, CapturedRayType type)
+{
+	Vector direction = ray.direction;
+	direction.normalize();
+
+	CapturedRay r;
+	r.origin[0] = ray.origin.x; r.origin[1] = ray.origin.y; r.origin[2] = ray.origin.z;
+	r.direction[0] = direction.x; r.direction[1] = direction.y; r.direction[2] = direction.z;
+	r.tmax = tmax;
+	r.type = type;
+	threadRays.push_back(r);
+
+	if (threadRays.size() >= CAPTURE_BLOCK) write(threadRays);
+}
+
+void RayCapture::FlushThread()
+{
+	if (!threadRays.empty()) write(threadRays);
+}
+
+void RayCapture::write(vector<CapturedRay>& rays)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		if (file && !failed) {
+			failed = fwrite(rays.data(), sizeof(CapturedRay), rays.size(), file) != rays.size();
+			count += rays.size();
+		}
+	}
+	rays.clear();
+}
+
+bool RayCapture::Close()
+{
+	FlushThread();
+
+	lock_guard<mutex> guard(lock);
+	if (file == NULL) return false;
+
+	uint64_t n = count;
+	if (!failed && fseek(file, offsetof(CaptureHeader, count), SEEK_SET) == 0)
+		failed = fwrite(&n, sizeof(n), 1, file) != 1;
+	failed = fclose(file) != 0 || failed;
+	file = NULL;
+
+	if (failed) printf("Error writing the ray capture file\n");
+	return !failed;
+}
+
+bool loadCapturedRays(const char* file_name, string& scene, vector<CapturedRay>& rays)
+{
+	FILE* file = fopen(file_name, "rb");
+	if (file == NULL) {
+		printf("Error opening the ray capture file %s\n", file_name);
+		return false;
+	}
+
+	CaptureHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && !strncmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic))
+		&& header.version == CAPTURE_VERSION && header.record_size == sizeof(CapturedRay);
+	if (ok) {
+		header.scene[sizeof(header.scene) - 1] = '\0';
+		scene = header.scene;
+		rays.resize((size_t)header.count);
+		ok = fread(rays.data(), sizeof(CapturedRay), rays.size(), file) == rays.size();
+	}
+	fclose(file);
+
+	if (!ok) printf("%s is not a complete ray capture file\n", file_name);
+	return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef RAY_CAPTURE_H
+#define RAY_CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include "ray.h"
+
+using namespace std;
+
+/*
+ Ray capture and replay.
+ While capturing, every ray the renderer traces is recorded to a binary file: a header with the scene file, then one
+ 32-byte record per ray with its origin, normalized direction, tmax and type. The replay mode reads the file back and
+ traces the rays through an accelerator alone, without shading nor sampling, so that accelerators can be compared on
+ exactly the same rays. Each thread buffers its rays and appends them to the file in blocks; the order of the blocks
+ of different threads is not kept.
+*/
+
+typedef enum { RAY_PRIMARY, RAY_SHADOW, RAY_SECONDARY, NUM_RAY_TYPES } CapturedRayType;
+
+struct CapturedRay {
+	float origin[3];
+	float direction[3];
+	float tmax;   //distance to the light for the shadow rays, FLT_MAX for the others
+	uint32_t type;
+};
+
+class RayCapture
+{
+public:
+	RayCapture();
+	~RayCapture();   //closes the file
+
+	bool Open(const char* file_name, const string& scene);
+	void Record(const Ray& ray, float tmax, CapturedRayType type);
+	void FlushThread();   //writes the rays buffered by the calling thread; call it before the thread ends
+	bool Close();   //writes the buffered rays of the calling thread and the number of rays in the header
+
+	unsigned long long getCount() { return count; }
+
+private:
+	void write(vector<CapturedRay>& rays);
+
+	FILE* file;
+	mutex lock;
+	unsigned long long count;
+	bool failed;
+};
+
+//Reads a capture file: the scene it was recorded from and its rays
+bool loadCapturedRays(const char* file_name, string& scene, vector<CapturedRay>& rays);
+
+#endif
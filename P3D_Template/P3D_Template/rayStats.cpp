@@ -0,0 +1,58 @@
+#include "rayStats.h"
+
+#ifdef RAY_STATS
+
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+thread_local RayStats threadStats;
+
+static RayStats totalStats;
+static std::mutex statsLock;
+
+void mergeThreadStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+	for (int i = 0; i < NUM_STATS; i++)
+		totalStats.counters[i] += threadStats.counters[i];
+	memset(&threadStats, 0, sizeof(threadStats));
+}
+
+void resetRayStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+	memset(&totalStats, 0, sizeof(totalStats));
+}
+
+RayStats getRayStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+	return totalStats;
+}
+
+void printRayStats()
+{
+	RayStats stats = getRayStats();
+	unsigned long long* c = stats.counters;
+	unsigned long long rays = c[STAT_PRIMARY_RAYS] + c[STAT_SHADOW_RAYS] + c[STAT_REFLECTION_RAYS] + c[STAT_REFRACTION_RAYS];
+	unsigned long long tests = c[STAT_SPHERE_TESTS] + c[STAT_TRIANGLE_TESTS] + c[STAT_PLANE_TESTS] + c[STAT_BOX_TESTS];
+	double per_ray = rays > 0 ? 1.0 / rays : 0;
+
+	printf("\nRAY STATS            total     per ray\n");
+	printf("  primary rays    %12llu\n", c[STAT_PRIMARY_RAYS]);
+	printf("  shadow rays     %12llu  %10.3f per primary\n", c[STAT_SHADOW_RAYS], c[STAT_PRIMARY_RAYS] ? (double)c[STAT_SHADOW_RAYS] / c[STAT_PRIMARY_RAYS] : 0);
+	printf("  reflection rays %12llu  %10.3f per primary\n", c[STAT_REFLECTION_RAYS], c[STAT_PRIMARY_RAYS] ? (double)c[STAT_REFLECTION_RAYS] / c[STAT_PRIMARY_RAYS] : 0);
+	printf("  refraction rays %12llu  %10.3f per primary\n", c[STAT_REFRACTION_RAYS], c[STAT_PRIMARY_RAYS] ? (double)c[STAT_REFRACTION_RAYS] / c[STAT_PRIMARY_RAYS] : 0);
+	printf("  all rays        %12llu\n", rays);
+	printf("  BVH nodes       %12llu  %10.3f\n", c[STAT_BVH_NODES], c[STAT_BVH_NODES] * per_ray);
+	printf("  grid cells      %12llu  %10.3f\n", c[STAT_GRID_CELLS], c[STAT_GRID_CELLS] * per_ray);
+	printf("  AABB tests      %12llu  %10.3f\n", c[STAT_AABB_TESTS], c[STAT_AABB_TESTS] * per_ray);
+	printf("  sphere tests    %12llu  %10.3f\n", c[STAT_SPHERE_TESTS], c[STAT_SPHERE_TESTS] * per_ray);
+	printf("  triangle tests  %12llu  %10.3f\n", c[STAT_TRIANGLE_TESTS], c[STAT_TRIANGLE_TESTS] * per_ray);
+	printf("  plane tests     %12llu  %10.3f\n", c[STAT_PLANE_TESTS], c[STAT_PLANE_TESTS] * per_ray);
+	printf("  box tests       %12llu  %10.3f\n", c[STAT_BOX_TESTS], c[STAT_BOX_TESTS] * per_ray);
+	printf("  primitive tests %12llu  %10.3f\n", tests, tests * per_ray);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RAY_STATS_H
+#define RAY_STATS_H
+
+/*
+ Ray and intersection statistics.
+ Compiled in only when RAY_STATS is defined (add it to the preprocessor definitions of the project); otherwise the
+ counters and the functions below compile to nothing. Each thread increments its own counters, which are added to
+ the totals when the thread finishes its part of the image.
+*/
+
+typedef enum {
+	STAT_PRIMARY_RAYS, STAT_SHADOW_RAYS, STAT_REFLECTION_RAYS, STAT_REFRACTION_RAYS,
+	STAT_BVH_NODES, STAT_GRID_CELLS,
+	STAT_SPHERE_TESTS, STAT_TRIANGLE_TESTS, STAT_PLANE_TESTS, STAT_BOX_TESTS, STAT_AABB_TESTS,
+	NUM_STATS
+} StatCounter;
+
+#ifdef RAY_STATS
+
+struct RayStats {
+	unsigned long long counters[NUM_STATS];
+};
+
+extern thread_local RayStats threadStats;
+
+#define STAT_INC(counter) (threadStats.counters[counter]++)
+
+void mergeThreadStats();   //adds the counters of the calling thread to the totals and clears them
+void resetRayStats();
+void printRayStats();
+RayStats getRayStats();
+
+#else
+
+#define STAT_INC(counter) ((void)0)
+
+inline void mergeThreadStats() {}
+inline void resetRayStats() {}
+inline void printRayStats() {}
+
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include "scene.h"
+#include "rayAccelerator.h"
+#include "imageWriter.h"
+#include "sceneGenerator.h"
+
+using namespace std;
+
+/*
+ The renderer of main.cpp as used by the headless modes of modes.cpp: the current scene and its accelerator, the
+ samples per pixel, scene loading, accelerator builds, ray queries and the rendering of an image.
+*/
+
+typedef enum {NONE, GRID_ACC, BVH_ACC, QBVH_ACC, NUM_ACCELERATORS} Accelerator;   //QBVH_ACC: BVH with quantized nodes
+
+extern Accelerator Accel_Struct;
+extern Grid* grid_ptr;
+extern BVH* bvh_ptr;
+extern Scene* scene;
+extern int RES_X, RES_Y;
+extern int spp;
+extern SceneGenParams genParams;
+extern ImageWriter* imageWriter;
+extern std::atomic<unsigned long long> raysTraced;
+
+bool parseAccel(const string& name, Accelerator& accel);   //name as on the command line: none, grid, bvh or qbvh
+const char* accelName(Accelerator accel);
+
+//The scene file as given, or else in P3D_Scenes; empty if it can be opened in neither
+string resolveSceneFile(const string& scene_file);
+
+Scene* load_scene(const char* scene_name);   //NULL if the scene could not be loaded
+Scene* generate_scene(unsigned long long count);   //with the other parameters of genParams
+void build_accelerator(Scene* a_scene, Grid** grid, BVH** bvh);   //of Accel_Struct
+
+void setSPP(int n);
+unsigned int renderThreads();
+void renderImage(Camera* camera, OutputImage* output, unsigned int n_threads);   //output NULL: only the rays are traced
+
+bool isPointObstructed(Vector& fromPoint, Vector& toPoint);
+Object* closestHit(Ray& ray, Vector& hitPoint);
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start);
+
+#endif
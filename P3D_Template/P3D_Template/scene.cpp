@@ -5,6 +5,10 @@
 
 #include "maths.h"
 #include "scene.h"
+#include "pagedMesh.h"
+#include "rayStats.h"
+
+#define TRIS_PER_PAGE 4096
 
 
 Triangle::Triangle(Vector& P0, Vector& P1, Vector& P2)
@@ -43,9 +47,7 @@ Vector Triangle::getNormal(Vector point)
 // Ray/Triangle intersection test using Tomas Moller-Ben Trumbore algorithm.
 //
 
-bool Triangle::intercepts(Ray& r, float& t ) {
-
-
+static inline bool intersectTriangle(Ray& r, Vector& p0, Vector& p0p1, Vector& p0p2, float& t) {
 	Vector projVec = r.direction % p0p2;
 	float det = p0p1 * projVec;
 
@@ -55,7 +57,7 @@ bool Triangle::intercepts(Ray& r, float& t ) {
 
 	float invDet = 1 / det;
 
-	Vector tvec = r.origin - points[0];
+	Vector tvec = r.origin - p0;
 	float u = tvec * projVec * invDet;
 	if (u < 0 || u > 1) return false;
 
@@ -65,10 +67,44 @@ bool Triangle::intercepts(Ray& r, float& t ) {
 
 	t = p0p2 * qvec * invDet;
 
-	return true;
+	return t >= 0;   //behind the origin of the ray: not a hit, as for the other primitives
 
 }
 
+bool Triangle::intercepts(Ray& r, float& t ) {
+	STAT_INC(STAT_TRIANGLE_TESTS);
+	return intersectTriangle(r, points[0], p0p1, p0p2, t);
+}
+
+CompactTriangle::CompactTriangle(Vector& P0, Vector& P1, Vector& P2)
+{
+	p0 = P0;
+	p0p1 = P1 - P0;
+	p0p2 = P2 - P0;
+}
+
+AABB CompactTriangle::GetBoundingBox() {
+	Vector p1 = p0 + p0p1, p2 = p0 + p0p2;
+	Vector Min = Vector(min(min(p0.x, p1.x), p2.x), min(min(p0.y, p1.y), p2.y), min(min(p0.z, p1.z), p2.z));
+	Vector Max = Vector(max(max(p0.x, p1.x), p2.x), max(max(p0.y, p1.y), p2.y), max(max(p0.z, p1.z), p2.z));
+
+	// enlarged like the box of a Triangle
+	Min -= EPSILON;
+	Max += EPSILON;
+	return(AABB(Min, Max));
+}
+
+Vector CompactTriangle::getNormal(Vector point)
+{
+	Vector normal = p0p1 % p0p2;   //the normal of a Triangle, -(P2 - P1) x (P2 - P0)
+	return normal.normalize();
+}
+
+bool CompactTriangle::intercepts(Ray& r, float& t) {
+	STAT_INC(STAT_TRIANGLE_TESTS);
+	return intersectTriangle(r, p0, p0p1, p0p2, t);
+}
+
 Plane::Plane(Vector& a_PN, float a_D)
 	: PN(a_PN), D(a_D)
 {}
@@ -104,6 +140,7 @@ Plane::Plane(Vector& P0, Vector& P1, Vector& P2)
 
 bool Plane::intercepts(Ray& r, float& t)
 {
+	STAT_INC(STAT_PLANE_TESTS);
 	//return false;
 	double denominator = PN * r.direction;
 	if (denominator < 0) {
@@ -123,6 +160,7 @@ Vector Plane::getNormal(Vector point)
 
 bool Sphere::intercepts(Ray& r, float& t )
 {
+	STAT_INC(STAT_SPHERE_TESTS);
     Vector oc = r.origin - center;
     float a = r.direction * r.direction;
     float b = oc * r.direction;
@@ -180,6 +218,7 @@ AABB aaBox::GetBoundingBox() {
 
 bool aaBox::intercepts(Ray& ray, float& t)
 {
+	STAT_INC(STAT_BOX_TESTS);
 	double ox = ray.origin.x; double oy = ray.origin.y; double oz = ray.origin.z;
 	double dx = ray.direction.x; double dy = ray.direction.y; double dz = ray.direction.z;
 
@@ -217,48 +256,33 @@ bool aaBox::intercepts(Ray& ray, float& t)
 	}
 
 	double tE, tL;//TE maior dos max 
-	Vector face_in, face_out; // normals
 
 	// find largest tE, entering t value
 
 	if (tx_min > ty_min) {
 		tE = tx_min;
-		face_in = (a >= 0.0f) ? Vector(-1, 0, 0) : Vector(1, 0, 0);
 	}
 	else {
 		tE = ty_min;
-		face_in = (b >= 0.0f) ? Vector(0, -1, 0) : Vector(0, 1, 0);
 	}
 	if (tz_min > tE) { //? help 
 		tE = tz_min;
-		face_in = (c >= 0.0f) ? Vector(0, 0, -1) : Vector(0, 0, 1);
 	}
 	// find smallest exiting tL, leaving t value
 
 	if (tx_max < ty_max) {
 		tL = tx_max;
-		face_out = (a >= 0.0f) ? Vector(1, 0, 0) : Vector(-1, 0, 0);
 	}
 	else {
 		tL = ty_max;
-		face_out = (b >= 0.0f) ? Vector(0, 1, 0) : Vector(0, -1, 0);
 	}
 
 	if (tz_max < tL) {
 		tL = tz_max;
-		face_out = (c >= 0.0f) ? Vector(0, 0, 1) : Vector(0, 0, -1);
 	}
 	
 	if (tE < tL && tL > 0.0f) {
-		if (tE > 0.f) {
-			t = tE;
-			Normal = face_in;
-		}
-		else {
-			t = tL;
-			Normal = face_out;
-
-		}
+		t = tE > 0.f ? tE : tL;
 		return true;
 	}
 
@@ -266,23 +290,54 @@ bool aaBox::intercepts(Ray& ray, float& t)
 
 }
 
-Vector aaBox::getNormal(Vector point)
+Vector aaBox::getNormal(Vector point)  //normal of the face closest to the point, so that no hit state is kept in the box
 {
+	float d[6] = { point.x - min.x, max.x - point.x, point.y - min.y, max.y - point.y, point.z - min.z, max.z - point.z };
+	int face = 0;
+	for (int i = 1; i < 6; i++)
+		if (fabs(d[i]) < fabs(d[face])) face = i;
+
+	Vector normal = Vector(0, 0, 0);
+	float sign = face % 2 == 0 ? -1.0f : 1.0f;
+	if (face < 2) normal.x = sign;
+	else if (face < 4) normal.y = sign;
+	else normal.z = sign;
+	return normal;
+}
+Scene::Scene() : camera(NULL), fuzzyReflector(NULL)
+{
+	for (int i = 0; i < 6; i++)
+		skybox_img[i] = NULL;
+	AddMaterial(Material());   //id 0, of the objects given no material
+}
 
-
-	return Normal;
+// Materials equal byte for byte share an id. Past MAX_MATERIALS distinct materials, the default one is returned.
+MaterialId Scene::AddMaterial(const Material& material)
+{
+	string key((const char*)&material, sizeof(Material));
+	unordered_map<string, MaterialId>::iterator found = materialIds.find(key);
+	if (found != materialIds.end()) return found->second;
+
+	if (materials.size() >= MAX_MATERIALS) {
+		if (materialIds.size() == MAX_MATERIALS)   //the first one past the limit
+			printf("More than %d materials: the default material is used for the others\n", MAX_MATERIALS);
+		materialIds[key] = 0;
+		return 0;
+	}
+	MaterialId id = (MaterialId)materials.size();
+	materials.push_back(material);
+	materialIds[key] = id;
+	return id;
 }
-Scene::Scene()
-{}
 
+// The primitives and lights are released with the arena; the skybox faces stay in the texture cache for other scenes
 Scene::~Scene()
 {
-	/*for ( int i = 0; i < objects.size(); i++ )
-	{
-		delete objects[i];
-	}
-	objects.erase();
-	*/
+	for (PagedMesh* mesh : pagedMeshes)
+		delete mesh;
+	delete pageCache;
+	delete camera;
+	delete fuzzyReflector;
 }
 
 int Scene::getNumObjects()
@@ -324,54 +379,31 @@ Light* Scene::getLight(unsigned int index)
 	return NULL;
 }
 
-void Scene::LoadSkybox(const char *sky_dir)
+void Scene::SetOutOfCore(size_t budget_bytes, unsigned int min_faces)
 {
-	char *filenames[6];
-	char buffer[100];
-	const char *maps[] = { "/right.jpg", "/left.jpg", "/top.jpg", "/bottom.jpg", "/front.jpg", "/back.jpg" };
+	if (pageCache == NULL)
+		pageCache = new PageCache(budget_bytes);
+	outOfCoreMinFaces = min_faces;
+}
 
-	for (int i = 0; i < 6; i++) {
-		strcpy_s(buffer, sizeof(buffer), sky_dir);
-		strcat_s(buffer, sizeof(buffer), maps[i]);
-		filenames[i] = (char *)malloc(sizeof(buffer));
-		strcpy_s(filenames[i], sizeof(buffer), buffer);
-	}
-	
-	ILuint ImageName;
+void Scene::PrintPagingStats()
+{
+	if (pageCache != NULL && pagedMeshes.size() > 0)
+		pageCache->PrintStats();
+}
 
-	ilEnable(IL_ORIGIN_SET);
-	ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+// The faces are only looked up in the texture cache here; each one is decoded when a ray first reaches it
+void Scene::LoadSkybox(const char *sky_dir)
+{
+	const char *maps[] = { "/right.jpg", "/left.jpg", "/top.jpg", "/bottom.jpg", "/front.jpg", "/back.jpg" };
 
 	for (int i = 0; i < 6; i++) {
-		ilGenImages(1, &ImageName);
-		ilBindImage(ImageName);
-
-		if (ilLoadImage(filenames[i]))  //Image loaded with lower left origin
-			printf("Skybox face %d: Image sucessfully loaded.\n", i);
-		else
+		skybox_img[i] = findTexture(string(sky_dir) + maps[i]);
+		if (skybox_img[i] == NULL) {
+			printf("Skybox face %s%s could not be opened\n", sky_dir, maps[i]);
 			exit(0);
-
-		ILint bpp = ilGetInteger(IL_IMAGE_BITS_PER_PIXEL);
-
-		ILenum format = IL_RGB;
-		printf("bpp=%d\n", bpp);
-		if (bpp == 24)
-			format = IL_RGB;
-		else if (bpp == 32)
-			format = IL_RGBA;
-
-		ilConvertImage(format, IL_UNSIGNED_BYTE);
-
-		int size = ilGetInteger(IL_IMAGE_SIZE_OF_DATA);
-		skybox_img[i].img = (ILubyte *)malloc(size);
-		ILubyte *bytes = ilGetData();
-		memcpy(skybox_img[i].img, bytes, size);
-		skybox_img[i].resX = ilGetInteger(IL_IMAGE_WIDTH);
-		skybox_img[i].resY = ilGetInteger(IL_IMAGE_HEIGHT);
-		format == IL_RGB ? skybox_img[i].BPP = 3 : skybox_img[i].BPP = 4;
-		ilDeleteImages(1, &ImageName);
+		}
 	}
-	ilDisable(IL_ORIGIN_SET);
 }
 
 Color Scene::GetSkyboxColor(Ray& r) {
@@ -438,18 +470,19 @@ Color Scene::GetSkyboxColor(Ray& r) {
 	s = (sc * invMa + 1) / 2;
 	t = (tc * invMa + 1) / 2;
 
-	width = skybox_img[img_side].resX;
-	height = skybox_img[img_side].resY;
-	bytesperpixel = skybox_img[img_side].BPP;
+	const Texture& face = skybox_img[img_side]->Decoded();
+	width = face.resX;
+	height = face.resY;
+	bytesperpixel = face.BPP;
 
 	xp = int((width - 1) * s);
 	xp < 0 ? 0 : (xp > (width - 1) ? width - 1 : xp);
 	yp = int((height - 1) * t);
 	yp < 0 ? 0 : (yp > (height - 1) ? height - 1 : yp);
 
-	float red = u8tofloat(skybox_img[img_side].img[(yp*width + xp) * bytesperpixel]);
-	float green = u8tofloat(skybox_img[img_side].img[(yp*width + xp) * bytesperpixel + 1]);
-	float blue = u8tofloat(skybox_img[img_side].img[(yp*width + xp) * bytesperpixel + 2]);
+	float red = u8tofloat(face.pixels[(yp*width + xp) * bytesperpixel]);
+	float green = u8tofloat(face.pixels[(yp*width + xp) * bytesperpixel + 1]);
+	float blue = u8tofloat(face.pixels[(yp*width + xp) * bytesperpixel + 2]);
 
 	return Color(red, green, blue);
 	
@@ -474,9 +507,7 @@ bool Scene::load_p3f(const char *name)
   string	cmd;
   char		token	[256];
   ifstream	file(name, ios::in);
-  Material *	material;
-
-  material = NULL;
+  MaterialId	material = 0;
 
   if (file >> cmd)
   {
@@ -490,7 +521,7 @@ bool Scene::load_p3f(const char *name)
 
 	    file >> cd >> Kd >> cs >> Ks >> Shine >> T >> ior;
 
-	    material = new Material(cd, Kd, cs, Ks, Shine, T, ior);
+	    material = AddMaterial(Material(cd, Kd, cs, Ks, Shine, T, ior));
       }
 
       else if (cmd == "s")    //Sphere
@@ -500,8 +531,8 @@ bool Scene::load_p3f(const char *name)
          Sphere* sphere;
 
 	    file >> center >> radius;
-        sphere = new Sphere(center,radius);
-	    if (material) sphere->SetMaterial(material);
+        sphere = arena.create<Sphere>(center,radius);
+	    sphere->SetMaterialId(material);
         this->addObject( (Object*) sphere);
       }
 
@@ -511,8 +542,8 @@ bool Scene::load_p3f(const char *name)
 		  aaBox	*box;
 
 		  file >> minpoint >> maxpoint;
-		  box = new aaBox(minpoint, maxpoint);
-		  if (material) box->SetMaterial(material);
+		  box = arena.create<aaBox>(minpoint, maxpoint);
+		  box->SetMaterialId(material);
 		  this->addObject((Object*)box);
 	  }
 	  else if (cmd == "p")  // Polygon: just accepts triangles for now
@@ -525,8 +556,8 @@ bool Scene::load_p3f(const char *name)
 		  if (total_vertices == 3)
 		  {
 			  file >> P0 >> P1 >> P2;
-			  triangle = new Triangle(P0, P1, P2);
-			  if (material) triangle->SetMaterial(material);
+			  triangle = arena.create<Triangle>(P0, P1, P2);
+			  triangle->SetMaterialId(material);
 			  this->addObject( (Object*) triangle);
 		  }
 		  else
@@ -539,20 +570,51 @@ bool Scene::load_p3f(const char *name)
 	  else if (cmd == "mesh") {
 		  unsigned total_vertices, total_faces;
 		  unsigned P0, P1, P2;
-		  Triangle* triangle;
 		  Vector* verticesArray, vertex;
 
 		  file >> total_vertices >> total_faces;
-		  verticesArray = (Vector*)malloc(total_vertices * sizeof(Vector));
-		  for (int i = 0; i < total_vertices; i++) {
-			  file >> vertex;
-			  verticesArray[i] = vertex;
+		  if (pageCache != NULL && total_faces > 0 && total_faces >= outOfCoreMinFaces) {  //out-of-core mesh, streamed to its pages
+			  char page_file[300];
+			  PagedMesh* mesh;
+
+			  sprintf(page_file, "%s.%d.pages", name, (int)pagedMeshes.size());
+			  mesh = new PagedMesh(pageCache);
+			  bool ok = mesh->BeginBuild(page_file, total_vertices, TRIS_PER_PAGE);
+			  for (int i = 0; ok && i < total_vertices; i++) {
+				  file >> vertex;
+				  ok = mesh->AddVertex(vertex);
+			  }
+			  for (int i = 0; ok && i < total_faces; i++) {
+				  file >> P0 >> P1 >> P2;
+				  ok = mesh->AddFace(P0 - 1, P1 - 1, P2 - 1);  //vertex index start at 1
+			  }
+			  if (!ok || !mesh->EndBuild()) {
+				  delete mesh;
+				  file.close();
+				  return false;
+			  }
+			  mesh->SetMaterialId(material);
+			  this->addObject((Object*)mesh);
+			  pagedMeshes.push_back(mesh);
 		  }
-		  for (int i = 0; i < total_faces; i++) {
-			  file >> P0 >> P1 >> P2;
-			  triangle = new Triangle(verticesArray[P0 - 1], verticesArray[P1 - 1], verticesArray[P2 - 1]); //vertex index start at 1
-			  if (material) triangle->SetMaterial(material);
-			  this->addObject((Object*)triangle);
+		  else {
+			  verticesArray = (Vector*)malloc(total_vertices * sizeof(Vector));
+			  for (int i = 0; i < total_vertices; i++) {
+				  file >> vertex;
+				  verticesArray[i] = vertex;
+			  }
+			  bool compact = compactMinFaces > 0 && total_faces >= compactMinFaces;
+			  for (int i = 0; i < total_faces; i++) {
+				  Object* face;
+				  file >> P0 >> P1 >> P2;
+				  if (compact)
+					  face = arena.create<CompactTriangle>(verticesArray[P0 - 1], verticesArray[P1 - 1], verticesArray[P2 - 1]);
+				  else
+					  face = arena.create<Triangle>(verticesArray[P0 - 1], verticesArray[P1 - 1], verticesArray[P2 - 1]); //vertex index start at 1
+				  face->SetMaterialId(material);
+				  this->addObject(face);
+			  }
+			  free(verticesArray);
 		  }
 
 	  }
@@ -563,8 +625,8 @@ bool Scene::load_p3f(const char *name)
 		  Plane* plane;
 
           file >> P0 >> P1 >> P2;
-          plane = new Plane(P0, P1, P2);
-	      if (material) plane->SetMaterial(material);
+          plane = arena.create<Plane>(P0, P1, P2);
+	      plane->SetMaterialId(material);
           this->addObject( (Object*) plane);
 	  }
 
@@ -575,7 +637,7 @@ bool Scene::load_p3f(const char *name)
 
 	    file >> pos >> color;
 	    
-	      this->addLight(new Light(pos, color));
+	      this->addLight(arena.create<Light>(pos, color));
 	    
       }
       else if (cmd == "v")
@@ -649,12 +711,13 @@ bool Scene::load_p3f(const char *name)
 
 void Scene::create_random_scene() {
 	Camera* camera;
-	Material* material;
+	MaterialId material;
 	Sphere* sphere;
 	FuzzyReflector* fuzzyreflector;
+	Vector center, light_pos[3] = { Vector(7, 10, -5), Vector(-7, 10, -5), Vector(0, 10, 7) };
+	Color white(1.0, 1.0, 1.0), black(0.0, 0.0, 0.0), diffuse, specular;
 
 	set_rand_seed(time(NULL) * time(NULL) * time(NULL));
-	material = NULL;
 	this->SetSkyBoxFlg(false);  //init with no skybox
 
 	this->SetBackgroundColor(Color(0.5, 0.7, 1.0));
@@ -664,17 +727,18 @@ void Scene::create_random_scene() {
 	camera = new Camera(Vector(13.0, 2.0, 3.0), Vector(0.0, 0.0, 0), Vector(0.0, 1.0, 0.0), 45.0, 0.01, 10000.0, 800, 600, 0, 1.5f);
 	this->SetCamera(camera);
 
-	this->addLight(new Light(Vector(7, 10, -5), Color(1.0, 1.0, 1.0)));
-	this->addLight(new Light(Vector(-7, 10, -5), Color(1.0, 1.0, 1.0)));
-	this->addLight(new Light(Vector(0, 10, 7), Color(1.0, 1.0, 1.0)));
+	for (int l = 0; l < 3; l++)
+		this->addLight(arena.create<Light>(light_pos[l], white));
 
-	material = new Material(Color(0.5, 0.5, 0.5), 1.0, Color(0.0, 0.0, 0.0), 0.0, 10, 0, 1);
+	diffuse = Color(0.5, 0.5, 0.5);
+	material = AddMaterial(Material(diffuse, 1.0, black, 0.0, 10, 0, 1));
 
 	fuzzyReflector = new FuzzyReflector();
 	this->setFuzzyReflector(fuzzyReflector);
 
-	sphere = new Sphere(Vector(0.0, -1000, 0.0), 1000.0);
-	if (material) sphere->SetMaterial(material);
+	center = Vector(0.0, -1000, 0.0);
+	sphere = arena.create<Sphere>(center, 1000.0);
+	sphere->SetMaterialId(material);
 	this->addObject((Object*)sphere);
 
 	for (int a = -5; a < 5; a++)
@@ -682,25 +746,27 @@ void Scene::create_random_scene() {
 
 			double choose_mat = rand_double();
 
-			Vector center = Vector(a + 0.9 * rand_double(), 0.2, b + 0.9 * rand_double());
+			center = Vector(a + 0.9 * rand_double(), 0.2, b + 0.9 * rand_double());
 
 			if ((center - Vector(4.0, 0.2, 0.0)).length() > 0.9) {
 				if (choose_mat < 0.4) {  //diffuse
-					material = new Material(Color(rand_double(), rand_double(), rand_double()), 1.0, Color(0.0, 0.0, 0.0), 0.0, 10, 0, 1);
-					sphere = new Sphere(center, 0.2);
-					if (material) sphere->SetMaterial(material);
+					diffuse = Color(rand_double(), rand_double(), rand_double());
+					material = AddMaterial(Material(diffuse, 1.0, black, 0.0, 10, 0, 1));
+					sphere = arena.create<Sphere>(center, 0.2);
+					sphere->SetMaterialId(material);
 					this->addObject((Object*)sphere);
 				}
 				else if (choose_mat < 0.9) {   //metal
-					material = new Material(Color(0.0, 0.0, 0.0), 0.0, Color(rand_double(0.5, 1), rand_double(0.5, 1), rand_double(0.5, 1)), 1.0, 220, 0, 1);
-					sphere = new Sphere(center, 0.2);
-					if (material) sphere->SetMaterial(material);
+					specular = Color(rand_double(0.5, 1), rand_double(0.5, 1), rand_double(0.5, 1));
+					material = AddMaterial(Material(black, 0.0, specular, 1.0, 220, 0, 1));
+					sphere = arena.create<Sphere>(center, 0.2);
+					sphere->SetMaterialId(material);
 					this->addObject((Object*)sphere);
 				}
 				else {   //glass 
-					material = new Material(Color(0.0, 0.0, 0.0), 0.0, Color(1.0, 1.0, 1.0), 0.7, 20, 1, 1.5);
-					sphere = new Sphere(center, 0.2);
-					if (material) sphere->SetMaterial(material);
+					material = AddMaterial(Material(black, 0.0, white, 0.7, 20, 1, 1.5));
+					sphere = arena.create<Sphere>(center, 0.2);
+					sphere->SetMaterialId(material);
 					this->addObject((Object*)sphere);
 				}
 
@@ -708,18 +774,23 @@ void Scene::create_random_scene() {
 
 		}
 
-	material = new Material(Color(0.0, 0.0, 0.0), 0.0, Color(1.0, 1.0, 1.0), 0.7, 20, 1, 1.5);
-	sphere = new Sphere(Vector(0.0, 1.0, 0.0), 1.0);
-	if (material) sphere->SetMaterial(material);
+	material = AddMaterial(Material(black, 0.0, white, 0.7, 20, 1, 1.5));
+	center = Vector(0.0, 1.0, 0.0);
+	sphere = arena.create<Sphere>(center, 1.0);
+	sphere->SetMaterialId(material);
 	this->addObject((Object*)sphere);
 
-	material = new Material(Color(0.4, 0.2, 0.1), 0.9, Color(1.0, 1.0, 1.0), 0.1, 10, 0, 1.0);
-	sphere = new Sphere(Vector(-4.0, 1.0, 0.0), 1.0);
-	if (material) sphere->SetMaterial(material);
+	diffuse = Color(0.4, 0.2, 0.1);
+	material = AddMaterial(Material(diffuse, 0.9, white, 0.1, 10, 0, 1.0));
+	center = Vector(-4.0, 1.0, 0.0);
+	sphere = arena.create<Sphere>(center, 1.0);
+	sphere->SetMaterialId(material);
 	this->addObject((Object*)sphere);
 
-	material = new Material(Color(0.4, 0.2, 0.1), 0.0, Color(0.7, 0.6, 0.5), 1.0, 220, 0, 1.0);
-	sphere = new Sphere(Vector(4.0, 1.0, 0.0), 1.0);
-	if (material) sphere->SetMaterial(material);
+	specular = Color(0.7, 0.6, 0.5);
+	material = AddMaterial(Material(diffuse, 0.0, specular, 1.0, 220, 0, 1.0));
+	center = Vector(4.0, 1.0, 0.0);
+	sphere = arena.create<Sphere>(center, 1.0);
+	sphere->SetMaterialId(material);
 	this->addObject((Object*)sphere);
 }
\ No newline at end of file
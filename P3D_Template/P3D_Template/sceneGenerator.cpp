@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "sceneGenerator.h"
+
+#define GEN_MATERIAL_RUN 4096   //consecutive primitives with the same material, so that the .p3f needs few material lines
+#define GEN_TEAPOT_FRACTION 0.9f
+#define GEN_TEAPOT_RADIUS (0.05f * GEN_EXTENT)
+
+static const char* distributionNames[NUM_GEN_DISTRIBUTIONS] = { "uniform", "clustered", "stadium" };
+
+struct GenMaterial {
+	float diff[3], Kd, spec[3], Ks, shine;
+};
+
+static const GenMaterial genMaterials[] = {
+	{ { 0.8f, 0.3f, 0.3f }, 0.9f, { 1, 1, 1 }, 0.1f, 10 },
+	{ { 0.3f, 0.8f, 0.3f }, 0.9f, { 1, 1, 1 }, 0.1f, 10 },
+	{ { 0.3f, 0.3f, 0.8f }, 0.9f, { 1, 1, 1 }, 0.1f, 10 },
+	{ { 0.9f, 0.8f, 0.4f }, 0.8f, { 1, 1, 1 }, 0.2f, 30 },
+	{ { 0.7f, 0.7f, 0.7f }, 0.8f, { 1, 1, 1 }, 0.2f, 30 },
+	{ { 0.2f, 0.2f, 0.2f }, 0.3f, { 0.9f, 0.9f, 0.9f }, 0.7f, 200 },
+	{ { 0.6f, 0.4f, 0.2f }, 0.5f, { 0.8f, 0.6f, 0.4f }, 0.5f, 100 },
+	{ { 0.5f, 0.2f, 0.6f }, 0.9f, { 1, 1, 1 }, 0.1f, 10 },
+};
+#define GEN_NUM_MATERIALS (int)(sizeof(genMaterials) / sizeof(genMaterials[0]))
+
+struct GenObject {
+	GenPrimitive type;
+	Vector p[3];   //sphere: center; triangle: vertices; box: min and max points
+	float radius;
+	int material;
+};
+
+// Produces the primitives of a scene one at a time
+class SceneGenerator
+{
+public:
+	SceneGenerator(const SceneGenParams& params_);
+	bool next(GenObject& object);
+
+private:
+	float uniform(float a, float b) { return uniform_dist(rng) * (b - a) + a; }
+	Vector uniformInCube(float half_size);
+	Vector randomDirection();
+	Vector position(float& size);
+
+	const SceneGenParams& params;
+	std::mt19937 rng;
+	std::uniform_real_distribution<float> uniform_dist;
+	std::normal_distribution<float> normal_dist;
+	unsigned long long n, n_teapot;
+	float mix_total;
+
+	vector<Vector> clusters;
+	float cluster_sigma;
+	float size, teapot_size;   //primitive size: of the cube, clusters or stadium ring, and of the teapot
+};
+
+// Size of count primitives filling volume about 40% apart
+static float primitiveSize(double volume, unsigned long long count)
+{
+	return (float)(0.4 * cbrt(volume / max(count, 1ULL)));
+}
+
+SceneGenerator::SceneGenerator(const SceneGenParams& params_) :
+	params(params_), rng(params_.seed), uniform_dist(0.0f, 1.0f), normal_dist(0.0f, 1.0f), n(0), n_teapot(0), cluster_sigma(0), teapot_size(0)
+{
+	mix_total = 0;
+	for (int t = 0; t < NUM_GEN_PRIMITIVES; t++)
+		mix_total += params.mix[t];
+
+	double cube = pow(2.0 * GEN_EXTENT, 3);
+	switch (params.distribution) {
+	case GEN_CLUSTERED: {
+		int n_clusters = max(1, (int)cbrt((double)params.count));
+		cluster_sigma = GEN_EXTENT / (2 * cbrt((double)n_clusters));
+		for (int c = 0; c < n_clusters; c++)
+			clusters.push_back(uniformInCube(GEN_EXTENT - 2 * cluster_sigma));
+		size = primitiveSize(n_clusters * pow(2.0 * cluster_sigma, 3), params.count);
+		break;
+	}
+	case GEN_STADIUM: {
+		n_teapot = (unsigned long long)(params.count * GEN_TEAPOT_FRACTION);
+		teapot_size = primitiveSize(4.19 * pow(GEN_TEAPOT_RADIUS, 3), n_teapot);
+		double ring = 3.14159 * (GEN_EXTENT * GEN_EXTENT - 0.64 * GEN_EXTENT * GEN_EXTENT) * 0.4 * GEN_EXTENT;
+		size = primitiveSize(ring, params.count - n_teapot);
+		break;
+	}
+	default:
+		size = primitiveSize(cube, params.count);
+	}
+}
+
+Vector SceneGenerator::uniformInCube(float half_size)
+{
+	float x = uniform(-half_size, half_size), y = uniform(-half_size, half_size), z = uniform(-half_size, half_size);
+	return Vector(x, y, z);
+}
+
+Vector SceneGenerator::randomDirection()
+{
+	Vector d;
+	do {
+		d = uniformInCube(1.0f);
+	} while (d * d > 1.0f || d * d < 1e-6f);
+	return d.normalize();
+}
+
+// Center of the next primitive and its size
+Vector SceneGenerator::position(float& object_size)
+{
+	object_size = size;
+	switch (params.distribution) {
+	case GEN_CLUSTERED: {
+		Vector center = clusters[std::uniform_int_distribution<size_t>(0, clusters.size() - 1)(rng)];
+		float x = normal_dist(rng), y = normal_dist(rng), z = normal_dist(rng);
+		return center + Vector(x, y, z) * cluster_sigma;
+	}
+	case GEN_STADIUM:
+		if (n < n_teapot) {
+			object_size = teapot_size;
+			Vector p;
+			do {
+				p = uniformInCube(1.0f);
+			} while (p * p > 1.0f);
+			return p * GEN_TEAPOT_RADIUS;
+		}
+		else {   //ring around the y axis, radius 0.8 to 1 of the extent, 0.4 of the extent high
+			float angle = uniform(0, 6.2831853f), radius = sqrtf(uniform(0.64f, 1.0f)) * GEN_EXTENT;
+			return Vector(radius * cosf(angle), uniform(-0.2f, 0.2f) * GEN_EXTENT, radius * sinf(angle));
+		}
+	default:
+		return uniformInCube(GEN_EXTENT);
+	}
+}
+
+bool SceneGenerator::next(GenObject& object)
+{
+	if (n >= params.count) return false;
+
+	float object_size;
+	Vector center = position(object_size);
+
+	float pick = uniform(0, mix_total);
+	int type = 0;
+	while (type < NUM_GEN_PRIMITIVES - 1 && pick >= params.mix[type]) {
+		pick -= params.mix[type];
+		type++;
+	}
+	object.type = (GenPrimitive)type;
+	object.material = (int)((n / GEN_MATERIAL_RUN) % GEN_NUM_MATERIALS);
+
+	switch (object.type) {
+	case GEN_SPHERE:
+		object.p[0] = center;
+		object.radius = object_size * uniform(0.5f, 1.0f);
+		break;
+	case GEN_TRIANGLE:
+		for (int v = 0; v < 3; v++)
+			object.p[v] = center + randomDirection() * (object_size * uniform(1.0f, 2.0f));
+		break;
+	case GEN_BOX: {
+		Vector half(object_size * uniform(0.5f, 1.0f), object_size * uniform(0.5f, 1.0f), object_size * uniform(0.5f, 1.0f));
+		object.p[0] = center - half;
+		object.p[1] = center + half;
+		break;
+	}
+	default:
+		break;
+	}
+
+	n++;
+	return true;
+}
+
+bool parseGenDistribution(const char* name, GenDistribution& distribution)
+{
+	for (int d = 0; d < NUM_GEN_DISTRIBUTIONS; d++)
+		if (!strcmp(name, distributionNames[d])) {
+			distribution = (GenDistribution)d;
+			return true;
+		}
+	return false;
+}
+
+const char* genDistributionName(GenDistribution distribution)
+{
+	return distributionNames[distribution];
+}
+
+bool parseGenMix(const char* weights, float mix[NUM_GEN_PRIMITIVES])
+{
+	float w[NUM_GEN_PRIMITIVES] = { 0, 0, 0 };
+	float total = 0;
+	const char* p = weights;
+	for (int t = 0; t < NUM_GEN_PRIMITIVES; t++) {
+		char* end;
+		w[t] = strtof(p, &end);
+		if (end == p || w[t] < 0) return false;
+		total += w[t];
+		p = end;
+		if (*p == '\0') break;
+		if (*p++ != ',') return false;
+	}
+	if (*p != '\0' || total <= 0) return false;
+
+	memcpy(mix, w, sizeof(w));
+	return true;
+}
+
+// The weights are written with 9 digits, enough for the floats to read back unchanged
+string genSceneName(const SceneGenParams& params)
+{
+	char name[256];
+	snprintf(name, sizeof(name), "gen:%llu:%s:%.9g,%.9g,%.9g:%u:%dx%d", params.count, distributionNames[params.distribution],
+		params.mix[0], params.mix[1], params.mix[2], params.seed, params.res_x, params.res_y);
+	return name;
+}
+
+bool parseGenSceneName(const string& name, SceneGenParams& params)
+{
+	if (name.compare(0, 4, "gen:")) return false;
+	SceneGenParams parsed = params;
+	char distribution[32], mix[128];
+	unsigned long long count;
+	int n = sscanf(name.c_str() + 4, "%llu:%31[^:]:%127[^:]:%u:%dx%d", &count, distribution, mix, &parsed.seed, &parsed.res_x, &parsed.res_y);
+	if (n < 1 || count == 0) return false;
+	parsed.count = count;
+	if (n > 1 && (n < 6 || !parseGenDistribution(distribution, parsed.distribution) || !parseGenMix(mix, parsed.mix)))
+		return false;
+
+	params = parsed;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////// CAMERA AND LIGHTS
+
+// Outside the cube looking at its center, or inside the stadium ring looking at the teapot
+static void genView(const SceneGenParams& params, Vector& from, Vector& at, Vector& up)
+{
+	if (params.distribution == GEN_STADIUM)
+		from = Vector(0.0f, 0.15f * GEN_EXTENT, 0.6f * GEN_EXTENT);
+	else
+		from = Vector(1.6f * GEN_EXTENT, 1.2f * GEN_EXTENT, 3.2f * GEN_EXTENT);
+	at = Vector(0, 0, 0);
+	up = Vector(0, 1, 0);
+}
+
+static const float genLights[3][3] = { { 0.7f, 1.0f, -0.5f }, { -0.7f, 1.0f, -0.5f }, { 0.0f, 1.0f, 0.7f } };
+
+void generateScene(Scene* scene, const SceneGenParams& params)
+{
+	Vector from, at, up;
+	genView(params, from, at, up);
+	Arena& arena = scene->GetArena();
+	scene->SetCamera(new Camera(from, at, up, 45.0f, 0.01f, 100.0f * 0.01f, params.res_x, params.res_y, 0, 1));
+	scene->SetBackgroundColor(Color(0.5, 0.7, 1.0));
+	scene->SetSkyBoxFlg(false);
+
+	for (int l = 0; l < 3; l++) {
+		Vector position = Vector(genLights[l][0], genLights[l][1], genLights[l][2]) * (2 * GEN_EXTENT);
+		Color color(1.0, 1.0, 1.0);
+		scene->addLight(arena.create<Light>(position, color));
+	}
+
+	MaterialId materials[GEN_NUM_MATERIALS];
+	for (int m = 0; m < GEN_NUM_MATERIALS; m++) {
+		const GenMaterial& g = genMaterials[m];
+		Color diff(g.diff[0], g.diff[1], g.diff[2]), spec(g.spec[0], g.spec[1], g.spec[2]);
+		materials[m] = scene->AddMaterial(Material(diff, g.Kd, spec, g.Ks, g.shine, 0, 1));
+	}
+
+	SceneGenerator generator(params);
+	GenObject g;
+	while (generator.next(g)) {
+		Object* object;
+		switch (g.type) {
+		case GEN_SPHERE: object = arena.create<Sphere>(g.p[0], g.radius); break;
+		case GEN_TRIANGLE: object = arena.create<Triangle>(g.p[0], g.p[1], g.p[2]); break;
+		default: object = arena.create<aaBox>(g.p[0], g.p[1]); break;
+		}
+		object->SetMaterialId(materials[g.material]);
+		scene->addObject(object);
+	}
+}
+
+bool writeGeneratedScene(const char* file_name, const SceneGenParams& params)
+{
+	FILE* file = fopen(file_name, "w");
+	if (file == NULL) {
+		printf("Error opening %s\n", file_name);
+		return false;
+	}
+
+	Vector from, at, up;
+	genView(params, from, at, up);
+	fprintf(file, "#synthetic scene: %llu primitives, %s, mix %g,%g,%g, seed %u\n", params.count, distributionNames[params.distribution],
+		params.mix[GEN_SPHERE], params.mix[GEN_TRIANGLE], params.mix[GEN_BOX], params.seed);
+	fprintf(file, "bclr 0.5 0.7 1\n");
+	fprintf(file, "v\nfrom %.9g %.9g %.9g\nat %.9g %.9g %.9g\nup %.9g %.9g %.9g\nangle 45\nhither 0.01\nresolution %d %d\naperture 0\nfocal 1\n",
+		from.x, from.y, from.z, at.x, at.y, at.z, up.x, up.y, up.z, params.res_x, params.res_y);
+	for (int l = 0; l < 3; l++)
+		fprintf(file, "l %.9g %.9g %.9g 1 1 1\n", genLights[l][0] * (2 * GEN_EXTENT), genLights[l][1] * (2 * GEN_EXTENT), genLights[l][2] * (2 * GEN_EXTENT));
+
+	SceneGenerator generator(params);
+	GenObject g;
+	int material = -1;
+	while (generator.next(g)) {
+		if (g.material != material) {
+			material = g.material;
+			const GenMaterial& m = genMaterials[material];
+			fprintf(file, "f %g %g %g %g %g %g %g %g %g 0 1\n", m.diff[0], m.diff[1], m.diff[2], m.Kd, m.spec[0], m.spec[1], m.spec[2], m.Ks, m.shine);
+		}
+		switch (g.type) {
+		case GEN_SPHERE:
+			fprintf(file, "s %.9g %.9g %.9g %.9g\n", g.p[0].x, g.p[0].y, g.p[0].z, g.radius);
+			break;
+		case GEN_TRIANGLE:
+			fprintf(file, "p 3\n%.9g %.9g %.9g\n%.9g %.9g %.9g\n%.9g %.9g %.9g\n",
+				g.p[0].x, g.p[0].y, g.p[0].z, g.p[1].x, g.p[1].y, g.p[1].z, g.p[2].x, g.p[2].y, g.p[2].z);
+			break;
+		default:
+			fprintf(file, "box %.9g %.9g %.9g %.9g %.9g %.9g\n", g.p[0].x, g.p[0].y, g.p[0].z, g.p[1].x, g.p[1].y, g.p[1].z);
+		}
+	}
+
+	bool ok = !ferror(file);
+	ok = fclose(file) == 0 && ok;
+	if (!ok) {
+		printf("Error writing %s\n", file_name);
+		return false;
+	}
+	return true;
+}
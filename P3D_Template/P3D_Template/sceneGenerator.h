@@ -0,0 +1,44 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include "scene.h"
+
+/*
+ Synthetic scenes for scaling studies: a given number of spheres, triangles and boxes, from a seed, so that the same
+ parameters always give the same scene. The primitives fill a cube of side 2 * GEN_EXTENT and shrink as their count
+ grows, so the part of the scene they cover stays about the same from 10^2 to 10^8 primitives:
+  - uniform: spread evenly over the cube
+  - clustered: gaussian clusters around cbrt(count) random centers
+  - stadium ("teapot in a stadium"): 90% of the primitives packed in a small ball at the center, seen from inside a
+    large sparse ring made of the rest
+ A scene is generated in memory or written as a .p3f file; the file is written as the primitives are generated, so
+ scenes too large for memory can be written.
+*/
+
+#define GEN_EXTENT 10.0f
+
+typedef enum { GEN_UNIFORM, GEN_CLUSTERED, GEN_STADIUM, NUM_GEN_DISTRIBUTIONS } GenDistribution;
+
+typedef enum { GEN_SPHERE, GEN_TRIANGLE, GEN_BOX, NUM_GEN_PRIMITIVES } GenPrimitive;
+
+struct SceneGenParams {
+	unsigned long long count;
+	GenDistribution distribution;
+	float mix[NUM_GEN_PRIMITIVES];   //relative weights of spheres, triangles and boxes
+	unsigned int seed;
+	int res_x, res_y;
+};
+
+bool parseGenDistribution(const char* name, GenDistribution& distribution);
+bool parseGenMix(const char* weights, float mix[NUM_GEN_PRIMITIVES]);   //e.g. "1,1,0": as many spheres as triangles
+const char* genDistributionName(GenDistribution distribution);
+
+//Name of a generated scene with all its parameters, "gen:<count>:<distribution>:<mix>:<seed>:<res_x>x<res_y>", e.g. for
+//the header of a ray capture, and its parsing; a name of the count alone ("gen:<count>") keeps the other parameters
+string genSceneName(const SceneGenParams& params);
+bool parseGenSceneName(const string& name, SceneGenParams& params);
+
+void generateScene(Scene* scene, const SceneGenParams& params);
+bool writeGeneratedScene(const char* file_name, const SceneGenParams& params);
+
+#endif
@@ -0,0 +1,115 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include <stdio.h>
+#include <algorithm>
+#include "sysinfo.h"
+
+size_t getPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	//VmHWM is the peak that resetPeakRSS restarts; ru_maxrss also keeps the peaks of the exited threads, and only grows
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file != NULL) {
+		char line[256];
+		size_t peak_kb = 0;
+		bool found = false;
+		while (!found && fgets(line, sizeof(line), file) != NULL)
+			found = sscanf(line, "VmHWM: %zu kB", &peak_kb) == 1;
+		fclose(file);
+		if (found) return peak_kb * 1024;
+	}
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+size_t getCurrentRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+#else
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+	size_t pages = 0, resident = 0;
+	int n = fscanf(file, "%zu %zu", &pages, &resident);
+	fclose(file);
+	return n == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+bool resetPeakRSS()
+{
+#ifdef _WIN32
+	return false;
+#else
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (file == NULL)
+		return false;
+	bool ok = fputs("5", file) >= 0;
+	return fclose(file) == 0 && ok;
+#endif
+}
+
+static bool hasExtension(const string& name, const string& extension)
+{
+	return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool makeDirectory(const string& dir)
+{
+#ifdef _WIN32
+	return CreateDirectoryA(dir.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+vector<string> listFiles(const string& dir, const string& extension)
+{
+	vector<string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "/*" + extension).c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && hasExtension(data.cFileName, extension))
+				names.push_back(data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	DIR* d = opendir(dir.c_str());
+	if (d != NULL) {
+		struct dirent* entry;
+		while ((entry = readdir(d)) != NULL)
+			if (hasExtension(entry->d_name, extension))
+				names.push_back(entry->d_name);
+		closedir(d);
+	}
+#endif
+	sort(names.begin(), names.end());
+	return names;
+}
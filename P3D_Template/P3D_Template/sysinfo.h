@@ -0,0 +1,24 @@
+#ifndef SYSINFO_H
+#define SYSINFO_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Peak resident memory (working set) of the process, in bytes
+size_t getPeakRSS();
+
+//Current resident memory (working set) of the process, in bytes; 0 when unknown
+size_t getCurrentRSS();
+
+//Restarts the peak resident memory from the current one, where the system allows it (Linux); returns false otherwise
+bool resetPeakRSS();
+
+//Creates a directory; true if it exists afterwards
+bool makeDirectory(const string& dir);
+
+//Names of the files of a directory with the given extension (".p3f"), sorted
+vector<string> listFiles(const string& dir, const string& extension);
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <unordered_map>
+#include <memory>
+#include <IL/il.h>
+#include "textureCache.h"
+#include "allocCounter.h"
+
+mutex devilLock;
+
+static mutex cacheLock;
+static unordered_map<string, unique_ptr<Texture> > textures;
+static atomic<unsigned int> cacheHits(0), decodes(0);
+
+Texture* findTexture(const string& path)
+{
+	lock_guard<mutex> guard(cacheLock);
+	unordered_map<string, unique_ptr<Texture> >::iterator found = textures.find(path);
+	if (found != textures.end()) {
+		cacheHits++;
+		return found->second.get();
+	}
+
+	FILE* file = fopen(path.c_str(), "rb");   //checked now, so that a missing file is reported with the scene
+	if (file == NULL) return NULL;
+	fclose(file);
+
+	Texture* texture = new Texture(path);
+	textures[path].reset(texture);
+	return texture;
+}
+
+static bool readFile(const string& path, vector<unsigned char>& bytes)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL) return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bytes.resize(size > 0 ? size : 0);
+	bool ok = size > 0 && fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	fclose(file);
+	return ok;
+}
+
+// A texture that fails to decode is left black, 1 x 1, rather than stopping a render under way
+void Texture::decode()
+{
+	lock_guard<mutex> guard(lock);
+	if (ready.load(memory_order_relaxed)) return;   //decoded by another thread meanwhile
+	unsigned long long allocs_start = threadAllocations();   //a one-off fill of the cache, not an allocation of the render loop
+
+	vector<unsigned char> file_bytes;
+	bool ok = readFile(path, file_bytes);
+
+	if (ok) {
+		lock_guard<mutex> devil_guard(devilLock);
+		ILuint image_id;
+		ilGenImages(1, &image_id);
+		ilBindImage(image_id);
+		ilEnable(IL_ORIGIN_SET);
+		ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+
+		ok = ilLoadL(IL_TYPE_UNKNOWN, file_bytes.data(), (ILuint)file_bytes.size()) != 0;
+		if (ok) {
+			BPP = ilGetInteger(IL_IMAGE_BITS_PER_PIXEL) == 32 ? 4 : 3;
+			ok = ilConvertImage(BPP == 4 ? IL_RGBA : IL_RGB, IL_UNSIGNED_BYTE) != 0;
+		}
+		if (ok) {
+			resX = ilGetInteger(IL_IMAGE_WIDTH);
+			resY = ilGetInteger(IL_IMAGE_HEIGHT);
+			ILubyte* bytes = ilGetData();
+			pixels.assign(bytes, bytes + (size_t)resX * resY * BPP);
+		}
+
+		ilDisable(IL_ORIGIN_SET);
+		ilDeleteImages(1, &image_id);
+	}
+
+	if (ok)
+		printf("Texture %s decoded: %u x %u, %u bytes per pixel\n", path.c_str(), resX, resY, BPP);
+	else {
+		printf("Texture %s could not be decoded; it is black\n", path.c_str());
+		resX = resY = 1;
+		BPP = 3;
+		pixels.assign(3, 0);
+	}
+	decodes++;
+	excludeThreadAllocations(threadAllocations() - allocs_start);
+	ready.store(true, memory_order_release);
+}
+
+void printTextureCacheStats()
+{
+	lock_guard<mutex> guard(cacheLock);
+	if (textures.empty()) return;
+	printf("Texture cache: %zu textures, %u decoded, %u lookups served by the cache\n", textures.size(), decodes.load(), cacheHits.load());
+}
@@ -0,0 +1,57 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+/*
+ Process-wide cache of the textures read with DevIL (the skybox faces), keyed by file path.
+ A scene looks its textures up when it is parsed, but each one is decoded only the first time its pixels are needed,
+ e.g. when a ray first reaches that face of the skybox, so faces that are never seen are never decoded. The scenes of a
+ batch that use the same files share a single decoded copy, kept until the process exits.
+ The files are read by the threads that first need them, in parallel; DevIL keeps its bound image as global state, so
+ the decodes themselves, like every other use of DevIL, hold devilLock.
+*/
+
+extern mutex devilLock;
+
+class Texture
+{
+public:
+	//The decoded texture, decoded by the first caller; after that only an atomic flag is tested
+	const Texture& Decoded()
+	{
+		if (!ready.load(memory_order_acquire)) decode();
+		return *this;
+	}
+
+	const string& GetPath() const { return path; }
+
+	unsigned int resX, resY;
+	unsigned int BPP;   //bytes per pixel, 3 or 4
+	vector<unsigned char> pixels;   //lower left origin
+
+private:
+	friend Texture* findTexture(const string& path);
+	Texture(const string& path_) : resX(0), resY(0), BPP(3), path(path_), ready(false) {}
+	Texture(const Texture&);
+	Texture& operator=(const Texture&);
+
+	void decode();
+
+	string path;
+	atomic<bool> ready;
+	mutex lock;   //of the decode
+};
+
+//Entry of the file in the cache, created on its first lookup, NULL when the file cannot be opened
+Texture* findTexture(const string& path);
+
+//Textures in the cache, decoded, and lookups served by an existing entry
+void printTextureCacheStats();
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "trace.h"
+#include "allocCounter.h"
+
+bool traceEnabled = false;
+
+struct TraceEvent {
+	const char* name;
+	const char* category;
+	int arg;
+	int tid;
+	long long ts, dur;   //microseconds since traceOpen
+};
+
+static string traceFile;
+static chrono::steady_clock::time_point traceStart;
+static vector<TraceEvent> traceEvents;
+static vector<pair<int, string> > threadNames;
+static mutex traceLock;
+static atomic<int> nextTid(1);
+
+static int traceTid()
+{
+	static thread_local int tid = nextTid++;
+	return tid;
+}
+
+static long long traceMicros(chrono::steady_clock::time_point t)
+{
+	return chrono::duration_cast<chrono::microseconds>(t - traceStart).count();
+}
+
+bool traceOpen(const char* file_name)
+{
+	FILE* file = fopen(file_name, "w");   //fails now rather than at exit
+	if (file == NULL) {
+		printf("Error opening the trace file %s\n", file_name);
+		return false;
+	}
+	fclose(file);
+
+	traceFile = file_name;
+	traceStart = chrono::steady_clock::now();
+	traceEnabled = true;
+	traceThreadName("main");
+	atexit(traceClose);
+	return true;
+}
+
+void traceThreadName(const char* name)
+{
+	static thread_local bool named = false;
+	if (!traceEnabled || named) return;
+	named = true;
+	lock_guard<mutex> guard(traceLock);
+	threadNames.push_back(make_pair(traceTid(), string(name)));
+}
+
+TraceSpan::~TraceSpan()
+{
+	if (!traceEnabled) return;
+
+	TraceEvent event;
+	event.name = name;
+	event.category = category;
+	event.arg = arg;
+	event.tid = traceTid();
+	event.ts = traceMicros(start);
+	event.dur = traceMicros(chrono::steady_clock::now()) - event.ts;
+
+	unsigned long long allocs_start = threadAllocations();   //the growth of the trace, not an allocation of the render loop
+	{
+		lock_guard<mutex> guard(traceLock);
+		traceEvents.push_back(event);
+	}
+	excludeThreadAllocations(threadAllocations() - allocs_start);
+}
+
+void traceClose()
+{
+	lock_guard<mutex> guard(traceLock);
+	if (!traceEnabled) return;
+	traceEnabled = false;
+
+	FILE* file = fopen(traceFile.c_str(), "w");
+	if (file == NULL) {
+		printf("Error writing the trace file %s\n", traceFile.c_str());
+		return;
+	}
+
+	//thread names first, as metadata events
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	const char* separator = "";
+	for (auto& thread_name : threadNames) {
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			separator, thread_name.first, thread_name.second.c_str());
+		separator = ",\n";
+	}
+	for (TraceEvent& e : traceEvents) {
+		fprintf(file, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld",
+			separator, e.name, e.category, e.tid, e.ts, e.dur);
+		if (e.arg >= 0) fprintf(file, ", \"args\": {\"n\": %d}", e.arg);
+		fprintf(file, "}");
+		separator = ",\n";
+	}
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) == 0)
+		printf("Trace of %zu events written to %s\n", traceEvents.size(), traceFile.c_str());
+	else
+		printf("Error writing the trace file %s\n", traceFile.c_str());
+	traceEvents.clear();
+}
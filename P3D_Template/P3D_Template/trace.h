@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+/*
+ Timeline trace in the Chrome trace-event JSON format (chrome://tracing, Perfetto).
+ Once traceOpen is called, every TraceSpan records a complete event on the timeline of its thread: scene parsing,
+ accelerator builds, the rows rendered by each thread, image encoding and the GL upload. The events are kept in
+ memory and the file is written by traceClose, which is also called at exit. While tracing is off a TraceSpan
+ only tests a flag.
+*/
+
+extern bool traceEnabled;
+
+bool traceOpen(const char* file_name);
+void traceClose();
+
+void traceThreadName(const char* name);   //name of the timeline of the calling thread
+
+class TraceSpan
+{
+public:
+	TraceSpan(const char* name_, const char* category_, int arg_ = -1) : name(name_), category(category_), arg(arg_)
+	{
+		if (traceEnabled) start = chrono::steady_clock::now();
+	}
+	~TraceSpan();
+
+private:
+	const char* name;
+	const char* category;
+	int arg;   //shown as the argument of the event (e.g. the row) when not negative
+	chrono::steady_clock::time_point start;
+};
+
+#endif